@@ -8,6 +8,8 @@
 #ifndef NETCODE_LIBRARY_INTERFACE_INCLUDE_GUARD
 #define NETCODE_LIBRARY_INTERFACE_INCLUDE_GUARD
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -18,41 +20,98 @@ extern "C" {
 typedef struct NCprotocol NCprotocol;
 typedef struct NCclass NCclass;
 typedef struct NCint NCint;
+typedef struct NCint64 NCint64;
+typedef struct NCfloat NCfloat;
+typedef struct NCvec NCvec;
+typedef struct NCbytes NCbytes;
+typedef struct NCarray NCarray;
 typedef struct NCref NCref;
 typedef struct NCauthority NCauthority;
 typedef struct NCpeer NCpeer;
 typedef struct NCobject NCobject;
 typedef struct NCblob NCblob;
+typedef struct NCsamples NCsamples;
+typedef int (* NCpredictor)(const NCsamples * samples, void * userdata);
      
 NCprotocol *     ncCreateProtocol       (int maxFrameDelta);
 NCclass *        ncCreateClass          (NCprotocol * protocol, int flags);
 NCint *          ncCreateInt            (NCclass * cl, int flags);
+NCint64 *        ncCreateInt64          (NCclass * cl, int flags);
+NCint *          ncCreateEnum           (NCclass * cl, int numValues, int flags);
+NCint *          ncCreateBool           (NCclass * cl, int flags);
+NCfloat *        ncCreateFloat          (NCclass * cl, float minValue, float maxValue, float precision, int flags);
+NCvec *          ncCreateVec            (NCclass * cl, int components, int flags);
+NCbytes *        ncCreateBytes          (NCclass * cl, int maxSize, int flags);
+NCarray *        ncCreateArray          (NCclass * cl, int capacity, int flags);
 NCref *          ncCreateRef            (NCclass * cl);
+void             ncAddFieldPredictor    (NCint * field, NCpredictor predictor, void * userdata);
+void             ncSetFieldContext      (NCint * field, const NCint * contextField);
+void             ncSetClassPriority     (NCclass * cl, int priority);
+void             ncSetAckWindow         (NCprotocol * protocol, int frames);
+void             ncSetPredictorWarmup   (NCprotocol * protocol, int values);
+void             ncSetSampleCandidates  (NCprotocol * protocol, int frames);
+void             ncDestroyProtocol      (NCprotocol * protocol);
 NCauthority *    ncCreateAuthority      (const NCprotocol * protocol);
                                         
 NCpeer *         ncCreatePeer           (NCauthority * authority);
 NCobject *       ncCreateLocalObject    (NCauthority * authority, const NCclass * cl);
 void             ncPublishFrame         (NCauthority * authority);
+void             ncPublishFrameAsync    (NCauthority * authority, NCpeer * const * peers, int count);
+void             ncCollectMessages      (NCauthority * authority, NCblob ** blobs);
 void             ncDestroyAuthority     (NCauthority * authority);
                                         
 const NCclass *  ncGetObjectClass       (const NCobject * object);
 int              ncGetObjectInt         (const NCobject * object, const NCint * field);
+double           ncGetObjectIntAt       (const NCobject * object, const NCint * field, double frame);
+void             ncGetObjectIntsAt      (const NCobject * object, const NCint * const * fields, int count, double frame, double * values);
+int64_t          ncGetObjectInt64       (const NCobject * object, const NCint64 * field);
+float            ncGetObjectFloat       (const NCobject * object, const NCfloat * field);
+float            ncGetObjectFloatAt     (const NCobject * object, const NCfloat * field, double frame);
+void             ncGetObjectVec         (const NCobject * object, const NCvec * field, int * values);
+const void *     ncGetObjectBytes       (const NCobject * object, const NCbytes * field, int * size);
+int              ncGetObjectArray       (const NCobject * object, const NCarray * field, int * values);
 const NCobject * ncGetObjectRef         (const NCobject * object, const NCref * field);
 void             ncSetObjectInt         (NCobject * object, const NCint * field, int value);
+void             ncSetObjectInt64       (NCobject * object, const NCint64 * field, int64_t value);
+void             ncSetObjectFloat       (NCobject * object, const NCfloat * field, float value);
+void             ncSetObjectVec         (NCobject * object, const NCvec * field, const int * values);
+void             ncSetObjectBytes       (NCobject * object, const NCbytes * field, const void * data, int size);
+void             ncSetObjectArray       (NCobject * object, const NCarray * field, const int * values, int length);
 void             ncSetObjectRef         (NCobject * object, const NCref * field, const NCobject * value);
+void             ncSetObjectPriority    (NCobject * object, int priority);
 void             ncDestroyObject        (NCobject * object);
 
+int              ncGetRemoteFrame       (const NCpeer * peer);
 int              ncGetRemoteObjectCount (const NCpeer * peer);
 const NCobject * ncGetRemoteObject      (const NCpeer * peer, int index);
+int              ncGetRemoteObjects     (const NCpeer * peer, const NCclass * cl, const NCobject ** objects);
+int              ncGetRemoteInts        (const NCpeer * peer, const NCint * field, int * values);
+int              ncGetRemoteFloats      (const NCpeer * peer, const NCfloat * field, float * values);
+int              ncGetCreatedCount      (const NCpeer * peer);
+const NCobject * ncGetCreatedObject     (const NCpeer * peer, int index);
+int              ncGetDestroyedCount    (const NCpeer * peer);
+const NCobject * ncGetDestroyedObject   (const NCpeer * peer, int index);
+int              ncGetChangedCount      (const NCpeer * peer);
+const NCobject * ncGetChangedObject     (const NCpeer * peer, int index);
+int              ncHasIntChanged        (const NCpeer * peer, int index, const NCint * field);
 void             ncSetVisibility        (NCpeer * peer, const NCobject * object, int isVisible);
+void             ncSetBandwidthBudget   (NCpeer * peer, int maxBytesPerMessage);
+void             ncSetMaxMessageSize    (NCpeer * peer, int maxBytes);
 NCblob *         ncProduceMessage       (NCpeer * peer);
+void             ncProduceMessages      (NCauthority * authority, NCpeer * const * peers, int count, NCblob ** blobs);
 void             ncConsumeMessage       (NCpeer * peer, const void * data, int size);
+void             ncConsumeMessages      (NCauthority * authority, NCpeer * const * peers, const void * const * data, const int * sizes, int count);
 void             ncDestroyPeer          (NCpeer * peer);
 
 const void *     ncGetBlobData          (const NCblob * blob);
 int              ncGetBlobSize          (const NCblob * blob);
+const NCblob *   ncGetNextBlob          (const NCblob * blob);
 void             ncFreeBlob             (NCblob * blob);
 
+int              ncGetSampleCount       (const NCsamples * samples);
+int              ncGetSampleFrameDelta  (const NCsamples * samples, int sample);
+int              ncGetSampleInt         (const NCsamples * samples, int sample, const NCint * field);
+
 #ifdef __cplusplus
 }
 #endif
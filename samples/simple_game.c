@@ -15,7 +15,8 @@
 /* Protocol data */
 NCprotocol * protocol;
 NCclass * unitClass, * deathEvent;
-NCint * teamField, * hpField, * xField, * yField;
+NCint * teamField, * hpField;
+NCfloat * xField, * yField;
 NCref * targetField;
 NCint * deathX, * deathY;
 
@@ -57,10 +58,10 @@ int main(int argc, char * argv[])
     /* init protocol */
     protocol = ncCreateProtocol(30);
     unitClass = ncCreateClass(protocol, 0);
-    teamField = ncCreateInt(unitClass, NC_CONST_FIELD_FLAG);
+    teamField = ncCreateEnum(unitClass, 2, NC_CONST_FIELD_FLAG);
     hpField = ncCreateInt(unitClass, 0);
-    xField = ncCreateInt(unitClass, 0);
-    yField = ncCreateInt(unitClass, 0);
+    xField = ncCreateFloat(unitClass, 0, 1280, 1, 0);
+    yField = ncCreateFloat(unitClass, 0, 720, 1, 0);
     targetField = ncCreateRef(unitClass);
     deathEvent = ncCreateClass(protocol, NC_EVENT_CLASS_FLAG);
     deathX = ncCreateInt(deathEvent, NC_CONST_FIELD_FLAG);
@@ -132,8 +133,8 @@ int main(int argc, char * argv[])
             /* update corresponding netcode object */
             ncSetObjectInt(units[i].object, teamField, units[i].team);
             ncSetObjectInt(units[i].object, hpField, units[i].hp);
-            ncSetObjectInt(units[i].object, xField, (int)units[i].x);
-            ncSetObjectInt(units[i].object, yField, (int)units[i].y);
+            ncSetObjectFloat(units[i].object, xField, units[i].x);
+            ncSetObjectFloat(units[i].object, yField, units[i].y);
             ncSetObjectRef(units[i].object, targetField, units[target].object);
             ncSetVisibility(serverPeer, units[i].object, 1); /* for now, all units are always visible, but we could implement a "fog of war" by manipulating this */
         }
@@ -166,12 +167,12 @@ int main(int argc, char * argv[])
             if(ncGetObjectClass(view) == unitClass)
             {
                 /* draw colored circle to represent unit */
-                x = ncGetObjectInt(view, xField);
-                y = ncGetObjectInt(view, yField);
+                x = (int)ncGetObjectFloat(view, xField);
+                y = (int)ncGetObjectFloat(view, yField);
                 
                 if(view2 = ncGetObjectRef(view, targetField))
                 {
-                    int x2 = ncGetObjectInt(view2, xField), y2 = ncGetObjectInt(view2, yField);
+                    int x2 = (int)ncGetObjectFloat(view2, xField), y2 = (int)ncGetObjectFloat(view2, yField);
                     glColor3f(1,1,1);
                     glBegin(GL_LINES);
                     glVertex2i(x,y);
@@ -23,7 +23,8 @@ void error(const char * message);
 NCprotocol * protocol;
 NCclass * teamClass, * unitClass, * deathEvent;
 NCint * teamId;
-NCint * unitTeamId, * unitHp, * unitX, * unitY;
+NCint * unitTeamId, * unitHp;
+NCfloat * unitX, * unitY;
 NCref * unitTarget;
 NCint * deathX, * deathY;
 
@@ -47,12 +48,12 @@ int main(int argc, char * argv[])
     /* initialize protocol */
     protocol = ncCreateProtocol(30);
     teamClass = ncCreateClass(protocol, 0);
-    teamId = ncCreateInt(teamClass, 0);
+    teamId = ncCreateEnum(teamClass, 2, 0);
     unitClass = ncCreateClass(protocol, 0);
-    unitTeamId = ncCreateInt(unitClass, NC_CONST_FIELD_FLAG);
+    unitTeamId = ncCreateEnum(unitClass, 2, NC_CONST_FIELD_FLAG);
     unitHp = ncCreateInt(unitClass, 0);
-    unitX = ncCreateInt(unitClass, 0);
-    unitY = ncCreateInt(unitClass, 0);
+    unitX = ncCreateFloat(unitClass, 0, WINDOW_WIDTH, 1, 0);
+    unitY = ncCreateFloat(unitClass, 0, WINDOW_HEIGHT, 1, 0);
     unitTarget = ncCreateRef(unitClass);
     deathEvent = ncCreateClass(protocol, NC_EVENT_CLASS_FLAG);
     deathX = ncCreateInt(deathEvent, NC_CONST_FIELD_FLAG);
@@ -270,8 +271,8 @@ void UpdateServer(struct Server * s, float timestep)
         /* set state for each object */
         ncSetObjectInt(s->units[i].nobj, unitTeamId, s->units[i].team);
         ncSetObjectInt(s->units[i].nobj, unitHp, s->units[i].hp);
-        ncSetObjectInt(s->units[i].nobj, unitX, (int)s->units[i].x);
-        ncSetObjectInt(s->units[i].nobj, unitY, (int)s->units[i].y);
+        ncSetObjectFloat(s->units[i].nobj, unitX, s->units[i].x);
+        ncSetObjectFloat(s->units[i].nobj, unitY, s->units[i].y);
         
         /* units are visible to their own team, and within 120 units of the other team's units */
         for(j=0; j<s->numPeers; ++j)
@@ -400,7 +401,7 @@ void UpdateClient(struct Client * c)
         const NCobject * nview = ncGetRemoteObject(c->peer, i);
         if(ncGetObjectClass(nview) == unitClass && ncGetObjectInt(nview, unitTeamId) == c->team)
         {
-            DrawCircle(ncGetObjectInt(nview, unitX), ncGetObjectInt(nview, unitY), 120);
+            DrawCircle((int)ncGetObjectFloat(nview, unitX), (int)ncGetObjectFloat(nview, unitY), 120);
         }
     }
 
@@ -410,8 +411,8 @@ void UpdateClient(struct Client * c)
         const NCobject * view = ncGetRemoteObject(c->peer, i), * view2;
         if(ncGetObjectClass(view) == unitClass)
         {
-            x = ncGetObjectInt(view, unitX);
-            y = ncGetObjectInt(view, unitY);
+            x = (int)ncGetObjectFloat(view, unitX);
+            y = (int)ncGetObjectFloat(view, unitY);
             switch(ncGetObjectInt(view, unitTeamId))
             {
             case 0: glColor3f(0,1,1); break;
@@ -421,7 +422,7 @@ void UpdateClient(struct Client * c)
             /* draw line to indicate unit's current target */
             if(view2 = ncGetObjectRef(view, unitTarget))
             {
-                int x2 = ncGetObjectInt(view2, unitX), y2 = ncGetObjectInt(view2, unitY);
+                int x2 = (int)ncGetObjectFloat(view2, unitX), y2 = (int)ncGetObjectFloat(view2, unitY);
                 glBegin(GL_LINES);
                 glVertex2i(x,y);
                 glVertex2i(x2,y2);
@@ -69,6 +69,7 @@ namespace netcode
             case 2: printf("(linear predictor)\n"); break;
             case 3: printf("(quadratic predictor)\n"); break;
             case 4: printf("(cubic predictor)\n"); break;
+            default: printf("(custom predictor %d)\n", best-5); break;
             }
             createCost += dist.dists[0].GetExpectedCost();
             updateCost += cost;
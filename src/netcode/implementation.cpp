@@ -7,33 +7,81 @@
 
 #include "implementation.h"
 
-struct NCblob { std::vector<uint8_t> memory; };
-
 NCprotocol *     ncCreateProtocol       (int maxFrameDelta)                                     { return new NCprotocol(maxFrameDelta); }
 NCclass *        ncCreateClass          (NCprotocol * protocol, int flags)                      { return new NCclass(protocol, flags & NC_EVENT_CLASS_FLAG); }
-NCint *          ncCreateInt            (NCclass * cl, int flags)                               { return (cl->isEvent && !(flags & NC_CONST_FIELD_FLAG)) ? nullptr : new NCint(cl, flags); }
-NCref *          ncCreateRef            (NCclass * cl)                                          { return cl->isEvent ? nullptr : new NCref(cl); }                               
+NCint *          ncCreateInt            (NCclass * cl, int flags)                               { return (cl->isEvent && !(flags & NC_CONST_FIELD_FLAG)) ? nullptr : cl->Own(new NCint(cl, flags)); }
+NCint64 *        ncCreateInt64          (NCclass * cl, int flags)                               { return (cl->isEvent && !(flags & NC_CONST_FIELD_FLAG)) ? nullptr : cl->Own(new NCint64(cl, flags)); }
+NCint *          ncCreateEnum           (NCclass * cl, int numValues, int flags)                { return (cl->isEvent && !(flags & NC_CONST_FIELD_FLAG)) || numValues < 1 || numValues > 256 ? nullptr : cl->Own(new NCint(cl, flags, numValues)); }
+NCint *          ncCreateBool           (NCclass * cl, int flags)                               { return ncCreateEnum(cl, 2, flags); }
+NCfloat *        ncCreateFloat          (NCclass * cl, float minValue, float maxValue, float precision, int flags) { return (cl->isEvent && !(flags & NC_CONST_FIELD_FLAG)) || !(precision > 0) || !(maxValue >= minValue) || (maxValue - minValue) / precision > INT_MAX / 2 ? nullptr : cl->Own(new NCfloat(cl, minValue, maxValue, precision, flags)); }
+NCvec *          ncCreateVec            (NCclass * cl, int components, int flags)               { return (cl->isEvent && !(flags & NC_CONST_FIELD_FLAG)) || components < 1 || components > netcode::maxVecComponents ? nullptr : cl->Own(new NCvec(cl, components, flags)); }
+NCbytes *        ncCreateBytes          (NCclass * cl, int maxSize, int flags)                  { return (cl->isEvent && !(flags & NC_CONST_FIELD_FLAG)) || maxSize < 0 ? nullptr : cl->Own(new NCbytes(cl, maxSize, flags)); }
+NCarray *        ncCreateArray          (NCclass * cl, int capacity, int flags)                 { return (cl->isEvent && !(flags & NC_CONST_FIELD_FLAG)) || capacity < 0 ? nullptr : cl->Own(new NCarray(cl, capacity, flags)); }
+NCref *          ncCreateRef            (NCclass * cl)                                          { return cl->isEvent ? nullptr : cl->Own(new NCref(cl)); }                               
+void             ncAddFieldPredictor    (NCint * field, NCpredictor predictor, void * userdata) { if(!field->isConst && !field->numValues && predictor && field->predictors.size() < netcode::maxFieldPredictors) field->predictors.push_back({predictor, userdata}); }
+void             ncSetFieldContext      (NCint * field, const NCint * contextField)             { field->SetContextField(contextField); }
+void             ncSetClassPriority     (NCclass * cl, int priority)                            { cl->priority = priority; }
+void             ncSetAckWindow         (NCprotocol * protocol, int frames)                     { protocol->ackWindow = std::max(std::min(frames, protocol->maxFrameDelta), 0); }
+void             ncSetPredictorWarmup   (NCprotocol * protocol, int values)                     { protocol->predictorWarmup = std::max(values, 0); }
+void             ncSetSampleCandidates  (NCprotocol * protocol, int frames)                     { protocol->sampleCandidates = std::max(std::min(frames, protocol->maxFrameDelta), 3); }
+void             ncDestroyProtocol      (NCprotocol * protocol)                                 { delete protocol; }
 NCauthority *    ncCreateAuthority      (const NCprotocol * protocol)                           { return new NCauthority(protocol); }
                                         
 NCpeer *         ncCreatePeer           (NCauthority * authority)                               { return authority->CreatePeer(); }
 NCobject *       ncCreateLocalObject    (NCauthority * authority, const NCclass * cl)           { return authority->CreateObject(cl); }
 void             ncPublishFrame         (NCauthority * authority)                               { return authority->PublishFrame(); }
+void             ncPublishFrameAsync    (NCauthority * authority, NCpeer * const * peers, int count) { authority->PublishFrameAsync(peers, count); }
+void             ncCollectMessages      (NCauthority * authority, NCblob ** blobs)              { authority->CollectMessages(blobs); }
 void             ncDestroyAuthority     (NCauthority * authority)                               { delete authority; }
                                         
 const NCclass *  ncGetObjectClass       (const NCobject * object)                               { return object->GetClass(); }
 int              ncGetObjectInt         (const NCobject * object, const NCint * field)          { return object->GetInt(field); }
+int64_t          ncGetObjectInt64       (const NCobject * object, const NCint64 * field)        { return object->GetInt64(field); }
+double           ncGetObjectIntAt       (const NCobject * object, const NCint * field, double frame) { double value; object->GetIntsAt(&field, 1, frame, &value); return value; }
+void             ncGetObjectIntsAt      (const NCobject * object, const NCint * const * fields, int count, double frame, double * values) { object->GetIntsAt(fields, count, frame, values); }
+float            ncGetObjectFloat       (const NCobject * object, const NCfloat * field)        { return field->Dequantize(object->GetInt(&field->field)); }
+float            ncGetObjectFloatAt     (const NCobject * object, const NCfloat * field, double frame) { return field->Dequantize(ncGetObjectIntAt(object, &field->field, frame)); }
+void             ncGetObjectVec         (const NCobject * object, const NCvec * field, int * values) { object->GetVec(field, values); }
+const void *     ncGetObjectBytes       (const NCobject * object, const NCbytes * field, int * size) { auto & blob = object->GetBytes(field); if(size) *size = blob.size(); return blob.data(); }
+int              ncGetObjectArray       (const NCobject * object, const NCarray * field, int * values) { return object->GetArray(field, values); }
 const NCobject * ncGetObjectRef         (const NCobject * object, const NCref * field)          { return object->GetRef(field); }
 void             ncSetObjectInt         (NCobject * o, const NCint * f, int value)              { o->SetInt(f, value); }
+void             ncSetObjectInt64       (NCobject * o, const NCint64 * f, int64_t value)        { o->SetInt64(f, value); }
+void             ncSetObjectFloat       (NCobject * o, const NCfloat * f, float value)          { o->SetInt(&f->field, f->Quantize(value)); }
+void             ncSetObjectVec         (NCobject * o, const NCvec * f, const int * values)     { o->SetVec(f, values); }
+void             ncSetObjectBytes       (NCobject * o, const NCbytes * f, const void * data, int size) { o->SetBytes(f, data, size); }
+void             ncSetObjectArray       (NCobject * o, const NCarray * f, const int * values, int length) { o->SetArray(f, values, length); }
 void             ncSetObjectRef         (NCobject * o, const NCref * f, const NCobject * value) { o->SetRef(f, value); }
+void             ncSetObjectPriority    (NCobject * object, int priority)                       { object->SetPriority(priority); }
 void             ncDestroyObject        (NCobject * object)                                     { object->Destroy(); }
 
+int              ncGetRemoteFrame       (const NCpeer * peer)                                   { return peer->remote.GetNewestFrame(); }
 int              ncGetRemoteObjectCount (const NCpeer * peer)                                   { return peer->remote.GetObjectCount(); }
 const NCobject * ncGetRemoteObject      (const NCpeer * peer, int index)                        { return peer->remote.GetObjectFromIndex(index); }
+int              ncGetRemoteObjects     (const NCpeer * peer, const NCclass * cl, const NCobject ** objects) { return peer->remote.GetObjects(cl, objects); }
+int              ncGetRemoteInts        (const NCpeer * peer, const NCint * field, int * values) { return peer->remote.GetInts(field, values); }
+int              ncGetRemoteFloats      (const NCpeer * peer, const NCfloat * field, float * values) { return peer->remote.GetFloats(field, values); }
+int              ncGetCreatedCount      (const NCpeer * peer)                                   { return peer->remote.GetCreatedObjectCount(); }
+const NCobject * ncGetCreatedObject     (const NCpeer * peer, int index)                        { return peer->remote.GetCreatedObject(index); }
+int              ncGetDestroyedCount    (const NCpeer * peer)                                   { return peer->remote.GetDestroyedObjectCount(); }
+const NCobject * ncGetDestroyedObject   (const NCpeer * peer, int index)                        { return peer->remote.GetDestroyedObject(index); }
+int              ncGetChangedCount      (const NCpeer * peer)                                   { return peer->remote.GetChangedObjectCount(); }
+const NCobject * ncGetChangedObject     (const NCpeer * peer, int index)                        { return peer->remote.GetChangedObject(index); }
+int              ncHasIntChanged        (const NCpeer * peer, int index, const NCint * field)   { return peer->remote.IsIntChanged(index, field); }
 void             ncSetVisibility        (NCpeer * peer, const NCobject * object, int isVisible) { object->SetVisibility(peer, !!isVisible); }
-NCblob *         ncProduceMessage       (NCpeer * peer)                                         { return new NCblob{peer->ProduceMessage()}; }
+void             ncSetBandwidthBudget   (NCpeer * peer, int maxBytesPerMessage)                 { if(peer->auth) peer->auth->WaitForMessages(); peer->local.SetBudget(maxBytesPerMessage); }
+void             ncSetMaxMessageSize    (NCpeer * peer, int maxBytes)                           { if(peer->auth) peer->auth->WaitForMessages(); peer->local.SetMaxMessageSize(maxBytes); }
+NCblob *         ncProduceMessage       (NCpeer * peer)                                         { if(peer->auth) peer->auth->WaitForMessages(); auto parts = peer->ProduceMessage(); return new NCblob(parts, 0); }
+void             ncProduceMessages      (NCauthority * authority, NCpeer * const * peers, int count, NCblob ** blobs) { authority->ProduceMessages(peers, count, blobs); }
 void             ncConsumeMessage       (NCpeer * peer, const void * data, int size)            { peer->ConsumeMessage(data, size); }
+void             ncConsumeMessages      (NCauthority * authority, NCpeer * const * peers, const void * const * data, const int * sizes, int count) { authority->ConsumeMessages(peers, data, sizes, count); }
 void             ncDestroyPeer          (NCpeer * peer)                                         { delete peer; }
                                                     
 const void *     ncGetBlobData          (const NCblob * blob)                                   { return blob->memory.data(); }
 int              ncGetBlobSize          (const NCblob * blob)                                   { return blob->memory.size(); }
-void             ncFreeBlob             (NCblob * blob)                                         { delete blob; }
\ No newline at end of file
+const NCblob *   ncGetNextBlob          (const NCblob * blob)                                   { return blob->next.get(); }
+void             ncFreeBlob             (NCblob * blob)                                         { delete blob; }
+
+int              ncGetSampleCount       (const NCsamples * samples)                             { return samples->sampleCount; }
+int              ncGetSampleFrameDelta  (const NCsamples * samples, int sample)                 { return sample > 0 && sample <= samples->sampleCount ? samples->frameDeltas[sample-1] : 0; }
+int              ncGetSampleInt         (const NCsamples * samples, int sample, const NCint * field) { return samples->GetInt(sample, field); }
\ No newline at end of file
@@ -11,6 +11,9 @@
 #include "netcode.h"
 #include "utility.h"
 
+#include <climits>
+#include <cmath>
+#include <cstring>
 #include <memory>
 #include <map>
 #include <set>
@@ -21,15 +24,39 @@ namespace netcode
     {
         std::vector<FieldDistribution> intFieldDists;
         std::vector<IntegerDistribution> intConstDists;
+        std::vector<Int64FieldDistribution> int64Dists;             // Distributions of 64-bit fields, of which constant fields only use the zero predictor
+        std::vector<EnumDistribution> varEnumDists;
+        std::vector<SymbolDistribution> constEnumDists;
+        std::vector<VecDistribution> vecDists;
+        std::vector<ArrayDistribution> arrayDists;
+        std::vector<SymbolDistribution> blobFieldDists;             // Whether each blob field's value is unchanged, in the dictionary, or sent in full
+        std::vector<int> blobDictionary;                            // Handles of the most recently sent blobs, oldest first, on whichever side is using these distributions
+        int blobsAdded;                                             // Total number of blobs ever added to the dictionary, including those since evicted
+        IntegerDistribution blobRecencyDist, blobSizeDist;
+        SymbolDistribution blobByteDist;
 	    IntegerDistribution eventCountDist, newObjectCountDist, delObjectCountDist;
+        IntegerDistribution delGapDist, delRunDist;                 // Gaps between runs of deleted indices, and the lengths of those runs
         IntegerDistribution uniqueIdDist;
+        IntegerDistribution newIdDist;                              // Differences between the IDs of new objects and the IDs predicted by PredictUniqueId(...)
         SymbolDistribution objectClassDist, eventClassDist;
+        SymbolDistribution partialUpdateDist, deferredObjectDist;
+        SymbolDistribution splitMessageDist;
 
         Distribs();
         Distribs(const NCprotocol & protocol);
 
-        void EncodeAndTallyObjectConstants(ArithmeticEncoder & encoder, const NCclass & cl, const std::vector<uint8_t> & state);
-        std::vector<uint8_t> DecodeAndTallyObjectConstants(ArithmeticDecoder & decoder, const NCclass & cl);
+        void Accumulate(const Distribs & base, const Distribs & part); // Add the values tallied by part since it was copied from base
+
+        void AddToBlobDictionary(int handle);
+        float GetBlobCost(const NCbytes & field, int handle, int prevHandle, const BlobTable & blobs) const; // A negative prevHandle indicates that there is no previous value
+        void EncodeAndTallyBlob(ArithmeticEncoder & encoder, const NCbytes & field, int handle, int prevHandle, const BlobTable & blobs);
+        int DecodeAndTallyBlob(ArithmeticDecoder & decoder, const NCbytes & field, int prevHandle, BlobTable & blobs);
+
+        void EncodeAndTallyDeletions(ArithmeticEncoder & encoder, const std::vector<int> & indices); // Indices must be in ascending order
+        std::vector<int> DecodeAndTallyDeletions(ArithmeticDecoder & decoder, size_t numPrevObjects);
+
+        void EncodeAndTallyObjectConstants(ArithmeticEncoder & encoder, const NCclass & cl, const std::vector<uint8_t> & state, const BlobTable & blobs);
+        std::vector<uint8_t> DecodeAndTallyObjectConstants(ArithmeticDecoder & decoder, const NCclass & cl, BlobTable & blobs);
     };
 
     class Frameset
@@ -37,35 +64,85 @@ namespace netcode
         int32_t frame, prevFrames[4];
         const uint8_t * prevStates[4];
         CurvePredictor predictors[5];
+        mutable std::vector<int> scratch;   // Working memory for PredictFields(...), reused between objects
 
-        int GetSampleCount(int frameAdded) const;
+        const int * PredictFields(const NCclass & cl, int stateOffset, int sampleCount) const; // Returns the prediction of curve predictor i for value j at [i*cl.GetPredictedCount() + j], where the variable fields are followed by the components of vector fields
+        void PredictInt64(const NCint64 & field, int stateOffset, int sampleCount, int64_t (&predictions)[5]) const;
+        void PredictCustom(const NCint & field, int stateOffset, int sampleCount, const uint8_t * state, int * predictions) const;
+        size_t GetFieldDistribution(const NCint & field, int stateOffset, int sampleCount, const uint8_t * state) const; // Returns the index of the distribution used for field in its current context
     public:
-        Frameset(const std::vector<int> & frames, const std::map<int, std::vector<uint8_t>> & frameStates);
+        Frameset(const NCprotocol & protocol, const std::vector<int> & frames, const std::map<int, std::vector<uint8_t>> & frameStates, const std::map<int, std::vector<uint8_t>> * peerStates = nullptr);
 
         int GetCurrentFrame() const { return frame; }
         int GetPreviousFrame() const { return prevFrames[0]; }
         int GetEarliestFrame() const { return prevFrames[3]; }
+        int GetFirstEventFrame(int maxFrameDelta) const { return std::max(prevFrames[0], frame - maxFrameDelta) + 1; } // Keyframes only carry events from frames which the authority still retains
+        const uint8_t * GetPreviousState() const { return prevStates[0]; }
+        int GetSampleCount(int frameAdded) const;
 
+        float GetObjectCost(const Distribs & distribs, const NCclass & cl, int stateOffset, int frameAdded, const uint8_t * state, const NCpeer & peer) const;
         void EncodeAndTallyObject(ArithmeticEncoder & encoder, Distribs & distribs, const NCclass & cl, int stateOffset, int frameAdded, const uint8_t * state, const NCpeer & peer) const;
-        void DecodeAndTallyObject(ArithmeticDecoder & decoder, Distribs & distribs, const NCclass & cl, int stateOffset, int frameAdded, uint8_t * state) const;
+        void DecodeAndTallyObject(ArithmeticDecoder & decoder, Distribs & distribs, const NCclass & cl, int stateOffset, int frameAdded, uint8_t * state, BlobTable & blobs) const;
     };
 
+    const size_t maxMessageParts = 256; // Maximum number of independently decodable parts that a single update can be split into
+    const size_t maxFieldPredictors = 8; // Maximum number of custom predictors which can be added to a single field
+    const size_t numFieldContexts = 4;   // Contexts for fields modeled by motion: unknown, stationary, moving slowly, moving quickly
+    const int maxVecComponents = 16;     // Maximum number of components of a single vector field
+    const size_t maxBlobDictionary = 256; // Number of recently sent blobs which can be referred to by each peer
+    const size_t maxCostedObjects = 16;  // Number of objects whose cost is estimated when choosing the samples for curve predictors
+
+    const int frameBits = 16;            // Number of low bits of frame numbers sent in message headers, which must greatly exceed the bits needed for maxFrameDelta
+
+    int ResolveFrame(code_t lowBits, int latestFrame); // Returns the latest frame not after latestFrame whose low frameBits bits are lowBits
+    // Keyframes carry the full current frame number, while other framelists only carry its low bits, as it is at most maxFrameDelta after a frame the remote peer has acknowledged
     void EncodeFramelist(ArithmeticEncoder & encoder, const int * frames, size_t numFrames, size_t maxFrames, int maxFrameDelta);
-    std::vector<int> DecodeFramelist(ArithmeticDecoder & decoder, size_t maxFrames, int maxFrameDelta);
+    std::vector<int> DecodeFramelist(ArithmeticDecoder & decoder, size_t maxFrames, int maxFrameDelta, int latestFrame); // latestFrame is the newest frame we have received
+    void EncodeAcks(ArithmeticEncoder & encoder, const std::vector<int> & frames, int window); // Frames must be in descending order, and within window of the first
+    std::vector<int> DecodeAcks(ArithmeticDecoder & decoder, int window, int latestFrame); // latestFrame is the newest frame we have sent
+    int PredictUniqueId(const std::vector<int> & usedIds, int prevId); // Returns the smallest ID greater than prevId which is not among the sorted usedIds, as assigned by a LocalSet recycling its lowest free IDs
 
     struct LocalObject;
 
+    struct Keyframe
+    {
+        int frame, maxMessageSize;
+        std::vector<std::pair<const LocalObject *, int>> objects;   // Objects which are live on this frame, and the unique IDs they were sent with
+        std::vector<std::vector<const LocalObject *>> events;       // Visible events sent with this keyframe, for each frame
+        std::vector<std::pair<const NCobject *, int>> foreignRefs;  // Referenced objects which are not among the objects above, and the IDs they were sent with
+        std::vector<std::vector<code_t>> tapes;                     // Calls made to the encoder by each part of the message, following the response
+        Distribs distribs;                                          // Probability distributions at the end of this frame
+    };
+
+    const size_t maxKeyframes = 16; // Maximum number of distinct keyframes which will be retained for the current frame
+
     class LocalSet
     {
         struct Record;
+        struct Update;
 
         const NCauthority * auth;                                       // Object authority whose objects may be visible to this peer
         std::vector<Record> records;                                    // Records of object visibility
         std::set<const LocalObject *> visibleEvents;                    // The set of events visible to this peer. Once ncPublishFrame(...) is called, the visibility of all events created that frame is frozen.
+        std::set<const LocalObject *> pendingEvents;                    // The set of unpublished events visible to this peer, kept apart from visibleEvents so that it may change while messages are being produced
         std::vector<std::pair<const LocalObject *,bool>> visChanges;    // Changes to visibility of objects (not events) since the last call to ncPublishFrame(...)
         std::map<int, Distribs> frameDistribs;                          // Probability distributions as they existed at the end of various frames
+        std::map<int, std::vector<uint8_t>> frameStates;                // Object state as seen by the remote peer, for frames in which some object updates were deferred
+        std::map<int, BlobRefs> frameBlobRefs;                          // References to the blobs in the dictionary of each frame's distributions, and in the previous state of objects deferred on that frame
         std::vector<int> ackFrames;                                     // The set of frames that has been acknowledged by the remote peer
-        int nextId;                                                     // The next network ID to use when sending to the remote peer
+        std::vector<int> sampledAcks;                                   // The set of acknowledged frames from which samples for curve predictors were last chosen
+        std::vector<int> sampleFrames;                                  // The acknowledged frames which were chosen as samples following the base frame
+        int nextId;                                                     // The next network ID to use when sending to the remote peer, if no freed IDs are available
+        std::set<int> freeIds;                                          // IDs below nextId which may be reused, as the remote peer no longer retains any frame in which they were live
+        std::vector<std::pair<int,int>> retiredIds;                     // Frames on which expired records were removed, and their IDs, which are freed once the remote peer has discarded those frames
+        int budget;                                                     // The maximum size in bytes of a message to the remote peer, or 0 if unlimited
+        int maxMessageSize;                                             // The maximum size in bytes of each part of a message to the remote peer, or 0 if messages should not be split
+
+        std::vector<int> SelectFrames(const NCpeer & peer); // Returns the current frame, followed by the acknowledged frames to predict from, of which the first is the base of the update
+        std::vector<float> SelectObjects(const Frameset & frameset, const Distribs & distribs, const std::vector<Record *> & liveRecords, const uint8_t * state, float bitsUsed, const NCpeer & peer);
+        int AllocateId();
+        void RetireId(int frameRemoved, int uniqueId);
+        std::vector<uint8_t> EncodePart(Update & update, size_t partIndex, size_t partCount, size_t first, size_t last, Distribs & distribs, size_t bitsUsed, std::vector<const Record *> & deferredRecords, NCpeer * peer);
     public:
         LocalSet(const NCauthority * auth);
         ~LocalSet();
@@ -76,8 +153,10 @@ namespace netcode
         int GetOldestAckFrame() const { return ackFrames.empty() ? 0 : ackFrames.back(); }
         void OnPublishFrame(int frame);
         void SetVisibility(const LocalObject * object, bool setVisible);
+        void SetBudget(int maxBytesPerMessage) { budget = std::max(maxBytesPerMessage, 0); }
+        void SetMaxMessageSize(int maxBytes) { maxMessageSize = std::max(maxBytes, 0); }
 
-        void ProduceUpdate(ArithmeticEncoder & encoder, NCpeer * peer);
+        std::vector<std::vector<uint8_t>> ProduceUpdate(NCpeer * peer);
         void ConsumeResponse(ArithmeticDecoder & decoder);    
         void PurgeReferences();
     };
@@ -91,16 +170,39 @@ namespace netcode
         RangeAllocator stateAlloc;
         std::map<int, Frame> frames;
         std::map<int, std::vector<uint8_t>> frameStates;
+        const uint8_t * latestState;                    // State of all objects on the newest frame, cached after each message so that reading a field does not search frameStates
         std::map<int, std::weak_ptr<Object>> id2View;
         std::vector<std::unique_ptr<Object>> events;
+        int eventFrame;                                 // The most recent frame whose events have been decoded
+        BlobTable blobs;                                // Contents of every blob received from the remote peer, referred to by handles in object state
+        std::map<int, BlobRefs> frameBlobRefs;          // References to the blobs in the state and dictionaries of each frame
+        std::vector<std::weak_ptr<Object>> recentViews;                 // Views which became visible after the oldest frame the remote peer may still refer to, which are absent from older base frames
+        std::vector<Object *> createdViews;                             // Views which became visible during the most recently consumed message
+        std::vector<std::shared_ptr<Object>> destroyedViews;            // Views which stopped being visible during the most recently consumed message, kept alive with their last state until the next message
+        std::vector<std::pair<const Object *, size_t>> changedViews;    // Views whose variable state changed during the most recently consumed message, with the offset of their previous state in changedStates
+        std::vector<uint8_t> changedStates;                             // Previous variable state of each changed view
+
+        template<class T, class F> int GetValues(const NCclass * cl, T * values, F getValue) const;
     public:
 	    RemoteSet(const NCprotocol * protocol);
         ~RemoteSet();
 
+        int GetNewestFrame() const;                     // Returns the newest frame received from the remote peer, or 0 if none have been received
         int GetObjectCount() const;
+        size_t GetBlobCount() const { return blobs.GetBlobCount(); }
         const NCobject * GetObjectFromIndex(int index) const;
         const NCobject * GetObjectFromUniqueId(int uniqueId) const;
         int GetUniqueIdFromObject(const NCobject * object) const;
+        int GetObjects(const NCclass * cl, const NCobject ** objects) const;  // Copies every remote object of the given class into objects, if it is not null, and returns the number of such objects
+        int GetInts(const NCint * field, int * values) const;                 // Copies the given field of every remote object of its class into values, in the order returned by GetObjects(...)
+        int GetFloats(const NCfloat * field, float * values) const;
+        int GetCreatedObjectCount() const { return createdViews.size(); }
+        const NCobject * GetCreatedObject(int index) const;
+        int GetDestroyedObjectCount() const { return destroyedViews.size(); }
+        const NCobject * GetDestroyedObject(int index) const;
+        int GetChangedObjectCount() const { return changedViews.size(); }
+        const NCobject * GetChangedObject(int index) const;
+        bool IsIntChanged(int index, const NCint * field) const;  // Returns true if the given field of the changed object at the given index holds a different value than before the most recently consumed message
 
 	    void ConsumeUpdate(ArithmeticDecoder & decoder, NCpeer * peer);
         void ProduceResponse(ArithmeticEncoder & encoder) const;
@@ -111,10 +213,98 @@ struct NCint
 {
     NCclass *                cl;             // Class that this field belongs to
     bool                     isConst;        // Whether or not this is a constant field
-    size_t                   uniqueId;       // Unique identifier for this integer field within the protocol
+    int                      numValues;      // Number of values of an enum field, which is stored in a single byte, or 0 for an integer field
+    size_t                   uniqueId;       // Unique identifier for this field among fields of the same kind within the protocol
     size_t                   dataOffset;     // Offset into object data where this field's value is stored
+    std::vector<std::pair<NCpredictor, void *>> predictors; // Custom predictors added by ncAddFieldPredictor(...), and their user data
+    const NCvec *            vec;            // Vector field which this field is a component of, or nullptr if it is not a component
+    const NCint *            contextField;   // Field whose motion selects the distribution used for this field, or nullptr if this field is not context modeled
+    size_t                   contextIds[netcode::numFieldContexts]; // Unique identifiers of the FieldDistributions used in each context, the first of which is uniqueId
+    int                      maxValue;       // Largest value of a field holding the steps of a float field, which are never negative, or 0 if the field is unbounded
+    
+    NCint(NCclass * cl, int flags, int numValues = 0);
+    NCint(const NCvec * vec, size_t component); // Creates a variable component of a vector field, which is coded jointly with the other components
+
+    int GetValue(const uint8_t * data) const { return numValues ? data[dataOffset] : reinterpret_cast<const int &>(data[dataOffset]); }
+    void SetValue(uint8_t * data, int value) const { if(numValues) data[dataOffset] = static_cast<uint8_t>(value); else reinterpret_cast<int &>(data[dataOffset]) = value; }
+    int ClampPrediction(int prediction) const { return maxValue ? std::min(std::max(prediction, 0), maxValue) : prediction; } // Predictions outside the range of a bounded field are always wrong
+    void SetContextField(const NCint * field);
+};
+
+struct NCint64
+{
+    NCclass *                cl;             // Class that this field belongs to
+    bool                     isConst;        // Whether or not this is a constant field
+    size_t                   uniqueId;       // Unique identifier for this field among 64-bit fields within the protocol
+    size_t                   dataOffset;     // Offset into object data where this field's value is stored, which is only guaranteed to be 4-byte aligned
+    
+    NCint64(NCclass * cl, int flags);
+
+    int64_t GetValue(const uint8_t * data) const { int64_t value; memcpy(&value, data + dataOffset, sizeof(value)); return value; }
+    void SetValue(uint8_t * data, int64_t value) const { memcpy(data + dataOffset, &value, sizeof(value)); }
+};
+
+struct NCfloat
+{
+    NCint                    field;          // Integer field holding the number of steps of size precision between minValue and the quantized value
+    float                    minValue;       // Smallest value which can be represented
+    float                    maxValue;       // Largest value which can be represented
+    float                    precision;      // Difference between consecutive representable values
+    int                      maxStep;        // Number of steps between the smallest and largest representable values, the last of which may be shorter than precision
+
+    NCfloat(NCclass * cl, float minValue, float maxValue, float precision, int flags);
+
+    int Quantize(float value) const; // Returns the step nearest to value, so that values outside the range are clamped
+    float Dequantize(double step) const { return static_cast<float>(std::min(std::max(minValue + step * precision, double(minValue)), double(maxValue))); } // Steps may be fractional when interpolated
+};
+
+struct NCvec
+{
+    NCclass *                cl;             // Class that this field belongs to
+    bool                     isConst;        // Whether or not this is a constant field, whose components are coded as independent constant integer fields
+    size_t                   uniqueId;       // Unique identifier for this field among variable vector fields within the protocol
+    size_t                   dataOffset;     // Offset into object data where the first component is stored, followed by the rest
+    size_t                   firstPrediction;// Index of the first component among the values predicted for this class, following the integer fields
+    std::vector<std::unique_ptr<NCint>> components; // Integer fields holding each component
     
-    NCint(NCclass * cl, int flags);
+    NCvec(NCclass * cl, int components, int flags);
+};
+
+struct NCbytes
+{
+    NCclass *                cl;             // Class that this field belongs to
+    bool                     isConst;        // Whether or not this is a constant field
+    int                      maxSize;        // Maximum size of this field's value, in bytes
+    size_t                   uniqueId;       // Unique identifier for this field among blob fields within the protocol
+    size_t                   dataOffset;     // Offset into object data where the handle of this field's value is stored, the contents of which are held in a BlobTable
+    
+    NCbytes(NCclass * cl, int maxSize, int flags);
+};
+
+struct NCarray
+{
+    NCclass *                cl;             // Class that this field belongs to
+    bool                     isConst;        // Whether or not this is a constant field
+    int                      capacity;       // Maximum number of elements
+    size_t                   uniqueId;       // Unique identifier for this field among array fields within the protocol
+    size_t                   dataOffset;     // Offset into object data where the length is stored, followed by capacity elements, of which those beyond the length are zero
+    
+    NCarray(NCclass * cl, int capacity, int flags);
+
+    int GetLength(const uint8_t * data) const { return reinterpret_cast<const int &>(data[dataOffset]); }
+    const int * GetElements(const uint8_t * data) const { return reinterpret_cast<const int *>(data + dataOffset) + 1; }
+    int * GetElements(uint8_t * data) const { return reinterpret_cast<int *>(data + dataOffset) + 1; }
+};
+
+struct NCsamples
+{
+    const NCint *            field;          // Field whose value is being predicted
+    const uint8_t *          state;          // Object data on the current frame, in which only fields preceding the predicted field are known
+    const uint8_t *          prevStates[4];  // Object data on each of the previous frames
+    int                      frameDeltas[4]; // Number of frames elapsed between each of the previous frames and the current frame
+    int                      sampleCount;    // Number of previous frames available
+
+    int GetInt(int sample, const NCint * field) const;
 };
 
 struct NCref
@@ -130,30 +320,61 @@ struct NCclass
     NCprotocol *             protocol;          // Protocol that this class belongs to
     bool                     isEvent;           // Whether or not this is an event class
     size_t                   uniqueId;          // Unique identifier for this class within the protocol
+    int                      priority;          // Default priority of objects of this class when updates must be deferred to fit a bandwidth budget
     size_t                   constSizeInBytes;  // Size of all constant fields, in bytes
     size_t                   varSizeInBytes;    // Size of all variable fields, in bytes
-    std::vector<NCint *>     constFields;       // Constant fields of this class
-    std::vector<NCint *>     varFields;         // Variable fields of this class
+    size_t                   constBytesEnd;     // End of the constant byte-sized fields packed into the last word reserved for them
+    size_t                   varBytesEnd;       // End of the variable byte-sized fields packed into the last word reserved for them
+    std::vector<NCint *>     constFields;       // Constant integer fields of this class
+    std::vector<NCint *>     varFields;         // Variable integer fields of this class
+    std::vector<NCint64 *>   constInt64s;       // Constant 64-bit integer fields of this class
+    std::vector<NCint64 *>   varInt64s;         // Variable 64-bit integer fields of this class
+    std::vector<NCint *>     constEnums;        // Constant enum fields of this class
+    std::vector<NCint *>     varEnums;          // Variable enum fields of this class
+    std::vector<NCvec *>     varVecs;           // Variable vector fields of this class
+    size_t                   varVecComponents;  // Total number of components of all variable vector fields
     std::vector<NCref *>     varRefs;           // Variable fields holding a reference to another object
+    std::vector<NCbytes *>   constBlobs;        // Constant fields holding a variable length blob
+    std::vector<NCbytes *>   varBlobs;          // Variable fields holding a variable length blob
+    std::vector<NCarray *>   constArrays;       // Constant fields holding a variable length array of integers
+    std::vector<NCarray *>   varArrays;         // Variable fields holding a variable length array of integers
+    std::vector<std::shared_ptr<void>> fields;  // Every field created on this class, which are destroyed along with it
 
     NCclass(NCprotocol * protocol, bool isEvent);
+
+    template<class T> T * Own(T * field) { fields.emplace_back(field); return field; }
+
+    size_t AllocateByte(bool isConst);
+    size_t GetPredictedCount() const { return varFields.size() + varVecComponents; } // Number of values predicted by curve predictors
 };
 
 struct NCprotocol
 {
     int                      maxFrameDelta;  // Maximum difference in frame numbers for frames used in delta compression
+    int                      ackWindow;      // Number of frames preceding the newest acknowledged frame whose receipt is also reported in each response
+    int                      predictorWarmup;// Number of consecutive values for which a field's best predictor must remain unchanged before it is locked in, or 0 to never lock
+    size_t                   sampleCandidates;// Number of acknowledged frames following the newest from which three are chosen as samples for curve predictors
     size_t                   numIntFields;   // Number of FieldDistributions used in this protocol
     size_t                   numIntConstants;// Number of constant integer fields used in this protocol
+    size_t                   numInt64Fields; // Number of 64-bit integer fields used in this protocol, both constant and variable
+    size_t                   numVarEnums;    // Number of variable enum fields used in this protocol
+    size_t                   numConstEnums;  // Number of constant enum fields used in this protocol
+    size_t                   numVarVecs;     // Number of variable vector fields used in this protocol
+    size_t                   numBlobFields;  // Number of blob fields used in this protocol, both constant and variable
+    size_t                   numArrayFields; // Number of array fields used in this protocol, both constant and variable
     std::vector<NCclass *>   objectClasses;  // Classes used for persistent objects
     std::vector<NCclass *>   eventClasses;   // Classes used for instantaneous events
+    mutable netcode::PredictorCache predictorCache; // Curve predictors for each combination of frame deltas, shared by every frameset using this protocol
 
     NCprotocol(int maxFrameDelta);
+    ~NCprotocol();
 };
 
 struct NCauthority
 {
 	const NCprotocol * protocol;
     netcode::RangeAllocator stateAlloc;
+    netcode::BlobTable blobs;                           // Contents of every blob assigned to a local object, referred to by handles in object state
 	std::vector<netcode::LocalObject *> objects;
     std::vector<netcode::LocalObject *> events;
     std::vector<NCpeer *> peers;
@@ -161,12 +382,28 @@ struct NCauthority
 	std::vector<uint8_t> state;
     std::map<int, std::vector<netcode::LocalObject *>> eventHistory;
     std::map<int, std::vector<uint8_t>> frameState;
+    std::map<int, netcode::BlobRefs> frameBlobRefs;     // References to the blobs held by variable fields in each published frame
     int frame;
 
+    std::unique_ptr<netcode::ThreadPool> threadPool;   // Worker threads used to produce messages for many peers at once, created on first use
+    std::vector<NCblob *> asyncMessages;                // Messages produced by the most recent call to ncPublishFrameAsync(...), which have yet to be collected
+    std::atomic<size_t> asyncRemaining;                 // Number of messages which are still being produced in the background
+    std::vector<netcode::LocalObject *> destroyedObjects; // Objects destroyed while messages were being produced, which may still be read by the message producers
+    mutable std::mutex keyframeMutex;
+    mutable std::vector<std::shared_ptr<const netcode::Keyframe>> keyframes; // Keyframes encoded for the current frame, which may be shared by any peers with the same visible objects and events
+
 	NCauthority(const NCprotocol * protocol);
     ~NCauthority();
 
+    netcode::ThreadPool & GetThreadPool();
+    bool IsProducingMessages() const { return asyncRemaining > 0; }
+    void WaitForMessages();
+
+    std::shared_ptr<const netcode::Keyframe> FindKeyframe(const netcode::Keyframe & key, const NCpeer & peer) const;
+    void AddKeyframe(std::shared_ptr<const netcode::Keyframe> keyframe) const;
+
     void PurgeReferencesToObject(NCobject * object);
+    void PurgeReferencesToObjects(std::vector<NCobject *> objects);
 
     /*const uint8_t * GetFrameState(int frame) const
     {
@@ -177,17 +414,50 @@ struct NCauthority
     NCpeer * CreatePeer();
 	netcode::LocalObject * CreateObject(const NCclass * objectClass);
     void PublishFrame();
+
+    // Produces a message for each of the given (distinct) peers in parallel. The authority, its objects and its published frames 
+    // are only read during this call, and the state of each peer is only accessed by the thread producing that peer's message.
+    void ProduceMessages(NCpeer * const * peers, int count, NCblob ** blobs);
+
+    // Publishes a frame and produces a message for each of the given peers in the background. Until the messages are collected, 
+    // objects may be created, modified and destroyed, but any call which reads or modifies the state of a peer or the published 
+    // frames will first wait for the messages to be produced.
+    void PublishFrameAsync(NCpeer * const * peers, int count);
+    void CollectMessages(NCblob ** blobs);
+
+    // Consumes messages received by the given peers, decoding messages for different peers in parallel. Messages for the same peer
+    // are consumed in order. Purging references to remote objects from each authority is deferred until all messages are decoded.
+    void ConsumeMessages(NCpeer * const * peers, const void * const * data, const int * sizes, int count);
+};
+
+struct NCblob 
+{ 
+    std::vector<uint8_t> memory;        // Contents of this part of the message
+    std::unique_ptr<NCblob> next;       // The next part of the message, if it was split into several parts
+
+    NCblob(std::vector<std::vector<uint8_t>> & parts, size_t index) : memory(move(parts[index])), next(index+1 < parts.size() ? new NCblob(parts, index+1) : nullptr) {}
 };
 
 struct NCobject
 {
     virtual const NCclass * GetClass() const = 0;
     virtual int GetInt(const NCint * field) const = 0;
+    virtual int64_t GetInt64(const NCint64 * field) const = 0;
     virtual const NCobject * GetRef(const NCref * field) const = 0;
+    virtual const std::vector<uint8_t> & GetBytes(const NCbytes * field) const = 0;
+    virtual int GetArray(const NCarray * field, int * values) const = 0; // Returns the length, and copies the elements to values if it is not nullptr
+    virtual void GetIntsAt(const NCint * const * fields, int count, double frame, double * values) const { for(int i=0; i<count; ++i) values[i] = GetInt(fields[i]); } // Objects without history report their current values
     virtual void SetVisibility(NCpeer * peer, bool isVisible) const {}
 
+    void GetVec(const NCvec * f, int * values) const { for(auto & c : f->components) *values++ = GetInt(c.get()); }
+
     virtual void SetInt(const NCint * f, int value) {}
+    virtual void SetInt64(const NCint64 * f, int64_t value) {}
+    void SetVec(const NCvec * f, const int * values) { for(auto & c : f->components) SetInt(c.get(), *values++); }
     virtual void SetRef(const NCref * f, const NCobject * value) {}
+    virtual void SetBytes(const NCbytes * f, const void * data, int size) {}
+    virtual void SetArray(const NCarray * f, const int * values, int length) {}
+    virtual void SetPriority(int priority) {}
     virtual void Destroy() {}
 };
 
@@ -196,14 +466,18 @@ struct NCpeer
     NCauthority * auth;
     netcode::LocalSet local;
     netcode::RemoteSet remote;
+    bool isDeferringPurges;                     // Whether references to destroyed remote objects should be purged later, as messages are being consumed in parallel
+    std::vector<NCobject *> deferredPurges;     // Destroyed remote objects whose references have yet to be purged from the authority
 
     NCpeer(NCauthority * auth);
     ~NCpeer();
 
     int GetNetId(const NCobject * object, int frame) const;
+    void PurgeReferencesToView(NCobject * view);
 
-    std::vector<uint8_t> ProduceMessage();
+    std::vector<std::vector<uint8_t>> ProduceMessage();
     void ConsumeMessage(const void * data, int size);
+    void DecodeMessage(const void * data, int size);
 };
 
 struct netcode::LocalObject : public NCobject
@@ -212,17 +486,26 @@ struct netcode::LocalObject : public NCobject
     const NCclass * cl;
     std::vector<uint8_t> constState;
 	int varStateOffset;
+    std::atomic<int> priority;
     bool isPublished;
 
 	LocalObject(NCauthority * auth, const NCclass * cl);
+    ~LocalObject();
 
     const NCclass * GetClass() const override { return cl; }
     int GetInt(const NCint * field) const override;
+    int64_t GetInt64(const NCint64 * field) const override;
     const NCobject * GetRef(const NCref * field) const override;
+    const std::vector<uint8_t> & GetBytes(const NCbytes * field) const override;
+    int GetArray(const NCarray * field, int * values) const override;
     void SetVisibility(NCpeer * peer, bool isVisible) const override;
 
     void SetInt(const NCint * f, int value) override;
+    void SetInt64(const NCint64 * f, int64_t value) override;
     void SetRef(const NCref * f, const NCobject * value) override;
+    void SetBytes(const NCbytes * f, const void * data, int size) override;
+    void SetArray(const NCarray * f, const int * values, int length) override;
+    void SetPriority(int priority) override { this->priority = priority; }
     void Destroy() override;
 };
 
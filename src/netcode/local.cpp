@@ -14,11 +14,12 @@ struct LocalSet::Record
 {
     const netcode::LocalObject * object; 
     int uniqueId, frameAdded, frameRemoved; 
+    int priority;                               // Accumulated priority, which grows for every message in which this object's update is deferred
 
     bool IsLive(int frame) const { return frameAdded <= frame && frame < frameRemoved; }
 };
 
-LocalSet::LocalSet(const NCauthority * auth) : auth(auth), nextId(1)
+LocalSet::LocalSet(const NCauthority * auth) : auth(auth), nextId(1), budget(0), maxMessageSize(0)
 {
 
 }
@@ -57,14 +58,49 @@ void LocalSet::OnPublishFrame(int frame)
     {
         auto it = std::find_if(begin(records), end(records), [=](Record & r) { return r.object == change.first && r.IsLive(frame); });
         if((it != end(records)) == change.second) continue; // If object visibility is as desired, skip this change
-        if(change.second) records.push_back({change.first, nextId++, frame, INT_MAX}); // Make object visible
+        if(change.second) records.push_back({change.first, AllocateId(), frame, INT_MAX, 0}); // Make object visible
         else it->frameRemoved = frame; // Make object invisible
     }
     visChanges.clear();
+    visibleEvents.insert(begin(pendingEvents), end(pendingEvents));
+    pendingEvents.clear();
 
+    // Frames older than maxFrameDelta can no longer be used as a base, so a peer which has stopped acknowledging frames will be sent keyframes
+    const int cutoff = auth->frame - auth->protocol->maxFrameDelta;
+    EraseIf(ackFrames, [=](int f) { return f < cutoff; });
     int oldestAck = GetOldestAckFrame();
-    EraseIf(records, [=](Record & r) { return r.frameRemoved < oldestAck || r.frameRemoved < auth->frame - auth->protocol->maxFrameDelta; });
-    frameDistribs.erase(begin(frameDistribs), frameDistribs.lower_bound(std::min(auth->frame - auth->protocol->maxFrameDelta, oldestAck)));
+    EraseIf(records, [=](Record & r) { if(r.frameRemoved < oldestAck || r.frameRemoved < cutoff) { RetireId(r.frameRemoved, r.uniqueId); return true; } return false; });
+
+    // The remote peer discards frames older than maxFrameDelta before its newest frame, after which the views of removed objects no longer exist
+    const int newestAck = ackFrames.empty() ? 0 : ackFrames.front();
+    EraseIf(retiredIds, [&](const std::pair<int,int> & r)
+    {
+        if(r.first + auth->protocol->maxFrameDelta > newestAck) return false;
+        freeIds.insert(r.second);
+        return true;
+    });
+    while(!freeIds.empty() && *freeIds.rbegin() == nextId-1)
+    {
+        freeIds.erase(nextId-1);
+        --nextId;
+    }
+    EraseBefore(frameDistribs, cutoff);
+    EraseBefore(frameStates, cutoff);
+    EraseBefore(frameBlobRefs, cutoff);
+}
+
+int LocalSet::AllocateId()
+{
+    // Reusing the lowest free ID keeps IDs small, and allows the remote peer to predict them
+    if(freeIds.empty()) return nextId++;
+    int id = *freeIds.begin();
+    freeIds.erase(begin(freeIds));
+    return id;
+}
+
+void LocalSet::RetireId(int frameRemoved, int uniqueId)
+{
+    retiredIds.push_back({frameRemoved, uniqueId});
 }
 
 void LocalSet::SetVisibility(const LocalObject * object, bool setVisible)
@@ -74,8 +110,8 @@ void LocalSet::SetVisibility(const LocalObject * object, bool setVisible)
     if(object->cl->isEvent)
     {
         if(object->isPublished) return;
-        if(setVisible) visibleEvents.insert(object);
-        else visibleEvents.erase(object);
+        if(setVisible) pendingEvents.insert(object);
+        else pendingEvents.erase(object);
     }
     else
     {
@@ -83,83 +119,349 @@ void LocalSet::SetVisibility(const LocalObject * object, bool setVisible)
     }
 }
 
-void LocalSet::ProduceUpdate(ArithmeticEncoder & encoder, NCpeer * peer)
+struct LocalSet::Update
+{
+    const std::vector<int> & frameList;
+    const Frameset & frameset;
+    std::vector<std::vector<const LocalObject *>> events;   // Visible events that occurred in each frame between the previous frame and the current frame
+    std::vector<int> deletedIndices;                        // Indices of objects which were live on the previous frame but not on the current frame
+    std::vector<Record *> liveRecords;                      // Objects which are live on the current frame, in the order in which the remote peer will store them
+    size_t firstNewRecord;                                  // Index of the first object in liveRecords which was added since the previous frame
+    const uint8_t * state;                                  // State of all objects on the current frame
+    bool isPartial;                                         // Whether any object updates may be deferred
+    float flagCost;                                         // Expected cost in bits of a deferred flag
+    std::vector<float> costs;                               // Costs in bits of updates which were selected by SelectObjects(...), or a negative value for deferred updates
+    std::vector<std::vector<code_t>> tapes;                 // Calls made to the encoder by each part following the response, recorded for keyframes so that they can be shared with other peers
+};
+
+std::vector<int> LocalSet::SelectFrames(const NCpeer & peer)
 {
-    std::vector<int> frameList = {auth->frame};
-    int32_t cutoff = auth->frame - auth->protocol->maxFrameDelta;
-    for(auto frame : ackFrames) if(frame >= cutoff) frameList.push_back(frame); // TODO: Enforce this in PublishFrame instead
+    // The newest acknowledged frame is the base of the update, as the fewest objects and distributions have changed since it
+    std::vector<int> frames = {auth->frame};
+    frames.insert(end(frames), begin(ackFrames), begin(ackFrames) + std::min(ackFrames.size(), size_t(4)));
+    const size_t n = std::min(ackFrames.size(), auth->protocol->sampleCandidates + 1);
+    if(n <= 4) return frames;
 
-    netcode::EncodeFramelist(encoder, frameList.data(), frameList.size(), 5, auth->protocol->maxFrameDelta);
-    const Frameset frameset(frameList, auth->frameState);
+    // Without gaps among the candidate frames, which is the usual case unless messages are being lost, the newest frames are used
+    if(ackFrames[n-1] == ackFrames[0] - int(n-1)) return frames;
 
-    // Obtain probability distributions for this frame
-    auto & distribs = frameDistribs[frameset.GetCurrentFrame()];
-    if(frameset.GetPreviousFrame() != 0) distribs = frameDistribs[frameset.GetPreviousFrame()];
-    else distribs = Distribs(*auth->protocol);
+    // The samples chosen for a set of acknowledged frames are kept until another frame is acknowledged, or an old one expires
+    if(ackFrames == sampledAcks)
+    {
+        std::copy(begin(sampleFrames), end(sampleFrames), begin(frames) + 2);
+        return frames;
+    }
+    sampledAcks = ackFrames;
+    sampleFrames.assign(begin(frames) + 2, end(frames));
+    auto distribs = frameDistribs.find(ackFrames[0]);
+    if(distribs == end(frameDistribs)) return frames;
 
-    // Encode visible events that occurred in each frame between the last acknowledged frame and the current frame
-    std::vector<const LocalObject *> sendEvents;
-    for(int i=frameset.GetPreviousFrame()+1; i<=frameset.GetCurrentFrame(); ++i)
+    // The spacing of the remaining samples determines how accurately curves extrapolate, which under heavy loss may be improved by skipping some of the newest 
+    // frames. Estimate the cost of a sample of objects for every choice of three of the following acknowledged frames, preferring the newest if none are cheaper.
+    std::vector<const Record *> costed;
+    for(auto & record : records) if(record.IsLive(ackFrames[0]) && record.IsLive(auth->frame)) costed.push_back(&record);
+    if(costed.empty()) return frames;
+    const size_t stride = (costed.size() + maxCostedObjects - 1) / maxCostedObjects;
+    const uint8_t * state = auth->frameState.find(auth->frame)->second.data();
+    auto getCost = [&](const std::vector<int> & candidate)
     {
-        sendEvents.clear();
-        for(auto e : auth->eventHistory.find(i)->second) if(visibleEvents.find(e) != end(visibleEvents)) sendEvents.push_back(e);
-        distribs.eventCountDist.EncodeAndTally(encoder, sendEvents.size());
-        for(auto e : sendEvents)
+        const Frameset frameset(*auth->protocol, candidate, auth->frameState, &frameStates);
+        float cost = 0;
+        for(size_t i=0; i<costed.size(); i += stride) cost += frameset.GetObjectCost(distribs->second, *costed[i]->object->cl, costed[i]->object->varStateOffset, costed[i]->frameAdded, state, peer);
+        return cost;
+    };
+    std::vector<int> candidate = frames;
+    float bestCost = getCost(frames);
+    for(size_t i=1; i<n; ++i) for(size_t j=i+1; j<n; ++j) for(size_t k=std::max(j+1, size_t(4)); k<n; ++k)
+    {
+        candidate[2] = ackFrames[i];
+        candidate[3] = ackFrames[j];
+        candidate[4] = ackFrames[k];
+        const float cost = getCost(candidate);
+        if(cost < bestCost)
         {
-            distribs.eventClassDist.EncodeAndTally(encoder, e->cl->uniqueId);
-            distribs.EncodeAndTallyObjectConstants(encoder, *e->cl, e->constState);
+            bestCost = cost;
+            frames = candidate;
         }
     }
+    sampleFrames.assign(begin(frames) + 2, end(frames));
+    return frames;
+}
+
+std::vector<std::vector<uint8_t>> LocalSet::ProduceUpdate(NCpeer * peer)
+{
+    const std::vector<int> frameList = SelectFrames(*peer);
+    const Frameset frameset(*auth->protocol, frameList, auth->frameState, &frameStates);
+    Update update = {frameList, frameset};
+
+    // Obtain probability distributions for the previous frame
+    const Distribs baseDistribs = frameset.GetPreviousFrame() != 0 ? frameDistribs[frameset.GetPreviousFrame()] : Distribs(*auth->protocol);
+
+    // Gather visible events that occurred in each frame between the last acknowledged frame and the current frame
+    for(int i=frameset.GetFirstEventFrame(auth->protocol->maxFrameDelta); i<=frameset.GetCurrentFrame(); ++i)
+    {
+        update.events.push_back({});
+        auto it = auth->eventHistory.find(i);
+        if(it == end(auth->eventHistory)) continue; // Frames which were never published carry no events
+        for(auto e : it->second) if(visibleEvents.find(e) != end(visibleEvents)) update.events.back().push_back(e);
+    }
 
-    // Encode the indices of destroyed objects
-    std::vector<int> deletedIndices;
-    std::vector<const Record *> newObjects;
+    // Gather the indices of destroyed objects, followed by all objects which are live on the current frame
     int index = 0;
-    for(const auto & record : records)
+    for(auto & record : records)
     {
         if(record.IsLive(frameset.GetPreviousFrame()))
         {
-            if(!record.IsLive(frameset.GetCurrentFrame())) deletedIndices.push_back(index);  // If it has been removed, store its index
-            ++index;                                                    // Either way, object was live, so it used an index
+            if(!record.IsLive(frameset.GetCurrentFrame())) update.deletedIndices.push_back(index);  // If it has been removed, store its index
+            ++index;                                                                                // Either way, object was live, so it used an index
+        }
+        if(record.IsLive(frameset.GetCurrentFrame())) update.liveRecords.push_back(&record);        // Objects added since the last frame always follow those that were already live
+    }
+    update.firstNewRecord = index - update.deletedIndices.size();
+    update.state = auth->frameState.find(frameset.GetCurrentFrame())->second.data();
+    update.isPartial = budget > 0 && frameset.GetPreviousFrame() != 0;
+    update.flagCost = baseDistribs.deferredObjectDist.GetExpectedCost() * 1.4427f + 0.25f; // Expected cost is measured in nats
+
+    // Peers which have not acknowledged any frames are sent a keyframe, which can be shared by all peers with the same visible objects and events
+    const bool isKeyframe = frameset.GetPreviousFrame() == 0;
+    Keyframe key = {frameset.GetCurrentFrame(), maxMessageSize};
+    if(isKeyframe)
+    {
+        for(auto record : update.liveRecords) key.objects.push_back({record->object, record->uniqueId});
+        key.events = update.events;
+        if(auto keyframe = auth->FindKeyframe(key, *peer))
+        {
+            // Replay the keyframe after our own response, and fast forward our state as though we had encoded it ourselves
+            std::vector<std::vector<uint8_t>> messages(keyframe->tapes.size());
+            for(size_t i=0; i<messages.size(); ++i)
+            {
+                ArithmeticEncoder encoder(messages[i]);
+                peer->remote.ProduceResponse(encoder);
+                encoder.Replay(keyframe->tapes[i]);
+                encoder.Finish();
+            }
+            frameDistribs[frameset.GetCurrentFrame()] = keyframe->distribs;
+            frameBlobRefs[frameset.GetCurrentFrame()] = BlobRefs(auth->blobs, keyframe->distribs.blobDictionary);
+            for(auto record : update.liveRecords) record->priority = 0;
+            frameStates.erase(frameset.GetCurrentFrame());
+            return messages;
         }
-        else if(record.IsLive(frameset.GetCurrentFrame())) // If object was added between last frame and now
+    }
+    const size_t responseSlack = isKeyframe ? 8 : 0; // Keyframes may be shared with peers whose responses are longer than our own
+
+    // Encode the update as a single message, splitting it into independently decodable parts if it exceeds our maximum message size
+    std::vector<std::vector<uint8_t>> messages;
+    std::vector<Distribs> partDistribs;
+    std::vector<const Record *> deferredRecords;
+    std::vector<std::pair<size_t,size_t>> ranges = {{0, update.liveRecords.size()}};
+    while(true)
+    {
+        messages.clear();
+        partDistribs.assign(ranges.size(), baseDistribs);
+        deferredRecords.clear();
+        if(isKeyframe) update.tapes.assign(ranges.size(), {});
+        size_t bitsUsed = 0;
+        std::vector<std::pair<size_t,size_t>> splitRanges;
+        for(size_t i=0; i<ranges.size(); ++i)
         {
-            newObjects.push_back(&record);
+            messages.push_back(EncodePart(update, i, ranges.size(), ranges[i].first, ranges[i].second, partDistribs[i], bitsUsed, deferredRecords, peer));
+            bitsUsed += messages.back().size() * 8;
+
+            // Divide oversized parts into enough smaller parts to fit within our maximum message size, with some room to spare
+            size_t count = ranges[i].second - ranges[i].first, pieces = 1;
+            if(maxMessageSize > 0 && messages.back().size() + responseSlack > size_t(maxMessageSize)) pieces = std::max(std::min(count, messages.back().size() * 5 / (maxMessageSize * 4) + 1), size_t(1));
+            for(size_t j=0; j<pieces; ++j) splitRanges.push_back({ranges[i].first + count*j/pieces, ranges[i].first + count*(j+1)/pieces});
         }
+        if(splitRanges.size() == ranges.size() || splitRanges.size() > maxMessageParts) break;
+        ranges.swap(splitRanges);
     }
-    int numPrevObjects = index;
-    distribs.delObjectCountDist.EncodeAndTally(encoder, deletedIndices.size());
-    for(auto index : deletedIndices) EncodeUniform(encoder, index, numPrevObjects);
 
-	// Encode classes of newly created objects
-	distribs.newObjectCountDist.EncodeAndTally(encoder, newObjects.size());
-	for (auto record : newObjects)
+    // Probability distributions at the end of this frame include the values tallied by all parts of the message
+    auto & distribs = frameDistribs[frameset.GetCurrentFrame()];
+    distribs = partDistribs[0];
+    for(size_t i=1; i<partDistribs.size(); ++i) distribs.Accumulate(baseDistribs, partDistribs[i]);
+
+    // Objects whose updates were sent no longer need to accumulate priority
+    std::sort(begin(deferredRecords), end(deferredRecords));
+    for(auto record : update.liveRecords) if(!std::binary_search(begin(deferredRecords), end(deferredRecords), record)) record->priority = 0;
+
+    // The remote peer will retain the previous state of deferred objects, so we must remember the state as they will see it
+    std::vector<int> handles = distribs.blobDictionary;
+    if(deferredRecords.empty()) frameStates.erase(frameset.GetCurrentFrame());
+    else
     {
+        auto & peerState = frameStates[frameset.GetCurrentFrame()];
+        peerState.assign(update.state, update.state + auth->frameState.find(frameset.GetCurrentFrame())->second.size());
+        for(auto record : deferredRecords)
+        {
+            auto offset = record->object->varStateOffset;
+            std::copy(frameset.GetPreviousState() + offset, frameset.GetPreviousState() + offset + record->object->cl->varSizeInBytes, peerState.data() + offset);
+            for(auto field : record->object->cl->varBlobs) handles.push_back(reinterpret_cast<const int &>(peerState[offset + field->dataOffset]));
+        }
+    }
+
+    // Blobs in our dictionary, or in the previous state of deferred objects, must not be evicted while this frame may be used as a base
+    frameBlobRefs[frameset.GetCurrentFrame()] = BlobRefs(auth->blobs, move(handles));
+
+    // Share this keyframe with other peers, noting the IDs sent for any referenced objects which other peers might not identify in the same way
+    if(isKeyframe)
+    {
+        std::vector<const NCobject *> liveObjects;
+        for(auto record : update.liveRecords) liveObjects.push_back(record->object);
+        std::sort(begin(liveObjects), end(liveObjects));
+        for(auto record : update.liveRecords)
+        {
+            for(auto field : record->object->cl->varRefs)
+            {
+                auto ref = reinterpret_cast<const NCobject * const &>(update.state[record->object->varStateOffset + field->dataOffset]);
+                if(ref && !std::binary_search(begin(liveObjects), end(liveObjects), ref)) key.foreignRefs.push_back({ref, peer->GetNetId(ref, frameset.GetCurrentFrame())});
+            }
+        }
+        key.tapes = std::move(update.tapes);
+        key.distribs = distribs;
+        auth->AddKeyframe(std::make_shared<Keyframe>(std::move(key)));
+    }
+    return messages;
+}
+
+std::vector<uint8_t> LocalSet::EncodePart(Update & update, size_t partIndex, size_t partCount, size_t first, size_t last, Distribs & distribs, size_t bitsUsed, std::vector<const Record *> & deferredRecords, NCpeer * peer)
+{
+    auto & frameset = update.frameset;
+    std::vector<uint8_t> buffer;
+    ArithmeticEncoder encoder(buffer);
+    peer->remote.ProduceResponse(encoder);
+    if(!update.tapes.empty()) encoder.Record(&update.tapes[partIndex]);
+    netcode::EncodeFramelist(encoder, update.frameList.data(), update.frameList.size(), 5, auth->protocol->maxFrameDelta);
+
+    // Encode which part of the message this is
+    distribs.splitMessageDist.EncodeAndTally(encoder, partCount > 1);
+    if(partCount > 1)
+    {
+        EncodeUniform(encoder, partCount-2, maxMessageParts-1);
+        EncodeUniform(encoder, partIndex, partCount);
+    }
+
+    // Encode visible events, which are only sent in the first part
+    if(partIndex == 0) for(auto & sendEvents : update.events)
+    {
+        distribs.eventCountDist.EncodeAndTally(encoder, sendEvents.size());
+        for(auto e : sendEvents)
+        {
+            distribs.eventClassDist.EncodeAndTally(encoder, e->cl->uniqueId);
+            distribs.EncodeAndTallyObjectConstants(encoder, *e->cl, e->constState, auth->blobs);
+        }
+    }
+
+    // Encode the indices of destroyed objects, which are sent in every part so that each part can be decoded independently
+    distribs.EncodeAndTallyDeletions(encoder, update.deletedIndices);
+
+	// Encode the range of objects updated by this part, and the classes of newly created objects within that range
+	distribs.newObjectCountDist.EncodeAndTally(encoder, update.liveRecords.size() - update.firstNewRecord);
+    if(partCount > 1)
+    {
+        EncodeUniform(encoder, first, update.liveRecords.size());
+        EncodeUniform(encoder, last - first - 1, update.liveRecords.size() - first);
+    }
+    std::vector<int> usedIds;
+    if(std::max(first, update.firstNewRecord) < last) for(auto & record : records) if(record.IsLive(frameset.GetPreviousFrame())) usedIds.push_back(record.uniqueId);
+    std::sort(begin(usedIds), end(usedIds));
+    int prevId = 0;
+	for(size_t i=std::max(first, update.firstNewRecord); i<last; ++i)
+    {
+        auto record = update.liveRecords[i];
         distribs.objectClassDist.EncodeAndTally(encoder, record->object->cl->uniqueId);
-        distribs.uniqueIdDist.EncodeAndTally(encoder, record->uniqueId);
-        distribs.EncodeAndTallyObjectConstants(encoder, *record->object->cl, record->object->constState);
+        distribs.newIdDist.EncodeAndTally(encoder, record->uniqueId - PredictUniqueId(usedIds, prevId));
+        prevId = record->uniqueId;
+        distribs.EncodeAndTallyObjectConstants(encoder, *record->object->cl, record->object->constState, auth->blobs);
     }
 
+    // Select which objects to update, deferring the lowest priority updates if the message would exceed our budget
+    auto remainingFlags = std::count_if(begin(update.liveRecords) + first, begin(update.liveRecords) + last, [&](const Record * r) { return frameset.GetSampleCount(r->frameAdded) > 0; });
+    if(update.isPartial && update.costs.empty()) update.costs = SelectObjects(frameset, distribs, update.liveRecords, update.state, encoder.GetBitCount() + remainingFlags * update.flagCost + 1, *peer);
+    distribs.partialUpdateDist.EncodeAndTally(encoder, update.isPartial);
+
 	// Encode updates for each view
-    auto state = auth->frameState.find(frameset.GetCurrentFrame())->second.data();
-    for(const auto & record : records)
+    for(size_t i=first; i<last; ++i)
     {
-        if(record.IsLive(frameset.GetCurrentFrame())) frameset.EncodeAndTallyObject(encoder, distribs, *record.object->cl, record.object->varStateOffset, record.frameAdded, state, *peer);
+        auto & record = *update.liveRecords[i];
+        if(update.isPartial && frameset.GetSampleCount(record.frameAdded) > 0)
+        {
+            // Objects selected for this message are still deferred if the actual encoded size has overrun our estimate
+            --remainingFlags;
+            auto cost = update.costs[i];
+            bool isDeferred = cost < 0 || (cost > 0 && bitsUsed + encoder.GetBitCount() + cost + remainingFlags * update.flagCost + 8 > budget * 8);
+            distribs.deferredObjectDist.EncodeAndTally(encoder, isDeferred);
+            if(isDeferred)
+            {
+                deferredRecords.push_back(&record);
+                continue;
+            }
+        }
+        frameset.EncodeAndTallyObject(encoder, distribs, *record.object->cl, record.object->varStateOffset, record.frameAdded, update.state, *peer);
     }
+    encoder.Finish();
+    return buffer;
+}
+
+std::vector<float> LocalSet::SelectObjects(const Frameset & frameset, const Distribs & distribs, const std::vector<Record *> & liveRecords, const uint8_t * state, float bitsUsed, const NCpeer & peer)
+{
+    // New objects must always be sent, as must objects whose references would change meaning if their old state was retained
+    std::vector<float> costs(liveRecords.size());
+    std::vector<size_t> candidates;
+    float bitsAvailable = budget * 8.0f - bitsUsed - 8; // Leave room to finish the final byte of the message
+    for(size_t i=0; i<liveRecords.size(); ++i)
+    {
+        auto & record = *liveRecords[i];
+        bool isDeferrable = frameset.GetSampleCount(record.frameAdded) > 0;
+        for(auto field : record.object->cl->varRefs)
+        {
+            if(!isDeferrable) break;
+            auto ref = reinterpret_cast<const NCobject * const &>(frameset.GetPreviousState()[record.object->varStateOffset + field->dataOffset]);
+            isDeferrable = peer.GetNetId(ref, frameset.GetPreviousFrame()) == peer.GetNetId(ref, frameset.GetCurrentFrame());
+        }
+        if(isDeferrable)
+        {
+            record.priority += record.object->priority;
+            candidates.push_back(i);
+        }
+        else bitsAvailable -= frameset.GetObjectCost(distribs, *record.object->cl, record.object->varStateOffset, record.frameAdded, state, peer);
+    }
+
+    // Choose the highest priority updates which fit within the remaining budget, marking the rest with a negative cost and the mandatory ones with zero cost
+    std::stable_sort(begin(candidates), end(candidates), [&](size_t a, size_t b) { return liveRecords[a]->priority > liveRecords[b]->priority; });
+    for(auto i : candidates) costs[i] = -1;
+    for(auto i : candidates)
+    {
+        auto & record = *liveRecords[i];
+        costs[i] = frameset.GetObjectCost(distribs, *record.object->cl, record.object->varStateOffset, record.frameAdded, state, peer) + 1;
+        if(costs[i] > bitsAvailable)
+        {
+            costs[i] = -1;
+            break;
+        }
+        bitsAvailable -= costs[i];
+    }
+    return costs;
 }
 
 void LocalSet::ConsumeResponse(ArithmeticDecoder & decoder) 
 {
     if(!auth) return;
-    auto newAck = netcode::DecodeFramelist(decoder, 4, auth->protocol->maxFrameDelta);
-    if(newAck.empty()) return;
-    if(ackFrames.empty() || ackFrames.front() < newAck.front()) ackFrames = newAck;
+    auto newAck = netcode::DecodeAcks(decoder, auth->protocol->ackWindow, auth->frame);
+
+    // Responses may be lost or arrive out of order, so accumulate every acknowledged frame which is still recent enough to be used as a base
+    ackFrames.insert(end(ackFrames), begin(newAck), end(newAck));
+    std::sort(begin(ackFrames), end(ackFrames), std::greater<int>());
+    ackFrames.erase(std::unique(begin(ackFrames), end(ackFrames)), end(ackFrames));
+    EraseIf(ackFrames, [=](int f) { return f < auth->frame - auth->protocol->maxFrameDelta; });
 }
 
 void LocalSet::PurgeReferences()
 {
+    frameBlobRefs.clear();
     auth = nullptr;
     records.clear();
     visibleEvents.clear();
+    pendingEvents.clear();
     visChanges.clear();      
 }
@@ -10,13 +10,16 @@
 
 using namespace netcode;
 
-NCauthority::NCauthority(const NCprotocol * protocol) : protocol(protocol), frame()
+NCauthority::NCauthority(const NCprotocol * protocol) : protocol(protocol), frame(), asyncRemaining(0)
 {
 
 }
 
 NCauthority::~NCauthority()
 {
+    WaitForMessages();
+    for(auto blob : asyncMessages) delete blob;
+
     // If there are any outstanding peers, remove any references they have to objects or to the authority
     for(auto peer : peers)
     {
@@ -28,6 +31,12 @@ NCauthority::~NCauthority()
     for(auto object : objects) object->auth = nullptr;
 }
 
+ThreadPool & NCauthority::GetThreadPool()
+{
+    if(!threadPool) threadPool.reset(new ThreadPool(std::max(std::thread::hardware_concurrency(), 2u) - 1)); // The calling thread also runs tasks
+    return *threadPool;
+}
+
 NCpeer * NCauthority::CreatePeer()
 {
 	auto peer = new NCpeer(this);
@@ -66,28 +75,71 @@ void NCauthority::PurgeReferencesToObject(NCobject * object)
     }
 }
 
+void NCauthority::WaitForMessages()
+{
+    if(IsProducingMessages()) GetThreadPool().Help([this]() { return !IsProducingMessages(); });
+
+    // Now that no messages are being produced, it is safe to delete objects which were destroyed in the meantime
+    for(auto object : destroyedObjects) delete object;
+    destroyedObjects.clear();
+}
+
+std::shared_ptr<const Keyframe> NCauthority::FindKeyframe(const Keyframe & key, const NCpeer & peer) const
+{
+    std::lock_guard<std::mutex> lock(keyframeMutex);
+    for(auto & keyframe : keyframes)
+    {
+        if(keyframe->frame != key.frame || keyframe->maxMessageSize != key.maxMessageSize || keyframe->objects != key.objects || keyframe->events != key.events) continue;
+        if(std::all_of(begin(keyframe->foreignRefs), end(keyframe->foreignRefs), [&](const std::pair<const NCobject *, int> & ref) { return peer.GetNetId(ref.first, key.frame) == ref.second; })) return keyframe;
+    }
+    return nullptr;
+}
+
+void NCauthority::AddKeyframe(std::shared_ptr<const Keyframe> keyframe) const
+{
+    std::lock_guard<std::mutex> lock(keyframeMutex);
+    if(keyframes.size() < maxKeyframes) keyframes.push_back(std::move(keyframe));
+}
+
+void NCauthority::PurgeReferencesToObjects(std::vector<NCobject *> objects)
+{
+    if(objects.empty()) return;
+    std::sort(begin(objects), end(objects));
+    for(auto obj : this->objects)
+    {
+        for(auto field : obj->cl->varRefs)
+        {
+            auto & ref = reinterpret_cast<NCobject * &>(state[obj->varStateOffset + field->dataOffset]);
+            if(std::binary_search(begin(objects), end(objects), ref)) ref = nullptr;
+        }
+    }
+}
+
 void NCauthority::PublishFrame()
 {
+    WaitForMessages();
+
     // Publish object state
     ++frame;
+    keyframes.clear();
     for(auto obj : objects) obj->isPublished = true;
     frameState[frame] = state;
 
+    // Published frames refer to the values of variable blob fields until they expire
+    std::vector<int> handles;
+    for(auto obj : objects) for(auto field : obj->cl->varBlobs) handles.push_back(reinterpret_cast<const int &>(state[obj->varStateOffset + field->dataOffset]));
+    frameBlobRefs[frame] = BlobRefs(blobs, move(handles));
+
     // Publish events which occurred this frame
     for(auto ev : events) ev->isPublished = true;
     eventHistory[frame] = std::move(events);
     events.clear();
 
     // Publish visibility changes and such
-    int oldestAck = INT_MAX;
-    for(auto peer : peers)
-    {
-        peer->local.OnPublishFrame(frame);
-        oldestAck = std::min(oldestAck, peer->local.GetOldestAckFrame());
-    }
+    for(auto peer : peers) peer->local.OnPublishFrame(frame);
 
-    // Once all clients have acknowledged a certain frame, expire all older frames
-    auto lastFrameToKeep = std::min(frame - protocol->maxFrameDelta, oldestAck);
+    // Peers can only use frames within maxFrameDelta of the current frame as a base, so expire all older frames, regardless of whether they have been acknowledged
+    auto lastFrameToKeep = frame - protocol->maxFrameDelta;
     EraseBefore(frameState, lastFrameToKeep);
 
     for(auto p : eventHistory)
@@ -100,6 +152,78 @@ void NCauthority::PublishFrame()
         }
     }
     EraseBefore(eventHistory, lastFrameToKeep);
+    EraseBefore(frameBlobRefs, lastFrameToKeep);
+
+    // No messages are being produced, so blobs which are no longer referred to by any object, retained frame, or peer's dictionary can be evicted
+    blobs.Collect();
+}
+
+void NCauthority::ProduceMessages(NCpeer * const * peers, int count, NCblob ** blobs)
+{
+    WaitForMessages();
+    GetThreadPool().ParallelFor(std::max(count, 0), [=](size_t i)
+    {
+        auto parts = peers[i]->ProduceMessage();
+        blobs[i] = new NCblob(parts, 0);
+    });
+}
+
+void NCauthority::PublishFrameAsync(NCpeer * const * peers, int count)
+{
+    PublishFrame();
+
+    // Discard any messages from the previous frame which were never collected
+    for(auto blob : asyncMessages) delete blob;
+    asyncMessages.assign(std::max(count, 0), nullptr);
+    asyncRemaining = asyncMessages.size();
+    for(size_t i=0; i<asyncMessages.size(); ++i)
+    {
+        auto peer = peers[i];
+        GetThreadPool().Submit([this, peer, i]()
+        {
+            auto parts = peer->ProduceMessage();
+            asyncMessages[i] = new NCblob(parts, 0);
+            --asyncRemaining;
+        });
+    }
+}
+
+void NCauthority::CollectMessages(NCblob ** blobs)
+{
+    WaitForMessages();
+    std::copy(begin(asyncMessages), end(asyncMessages), blobs);
+    asyncMessages.clear();
+}
+
+void NCauthority::ConsumeMessages(NCpeer * const * peers, const void * const * data, const int * sizes, int count)
+{
+    // Group messages by peer, as messages for the same peer must be consumed in order
+    std::map<NCpeer *, std::vector<int>> peerMessages;
+    for(int i=0; i<count; ++i) peerMessages[peers[i]].push_back(i);
+    std::vector<std::pair<NCpeer * const, std::vector<int>> *> tasks;
+    for(auto & p : peerMessages)
+    {
+        if(p.first->auth) p.first->auth->WaitForMessages();
+        p.first->isDeferringPurges = true;
+        tasks.push_back(&p);
+    }
+
+    GetThreadPool().ParallelFor(tasks.size(), [&](size_t i)
+    {
+        for(auto j : tasks[i]->second) tasks[i]->first->DecodeMessage(data[j], sizes[j]);
+    });
+
+    // Purge references to destroyed remote objects, in a single pass over the objects of each authority
+    std::vector<NCobject *> purged;
+    for(auto & p : peerMessages)
+    {
+        auto peer = p.first;
+        peer->isDeferringPurges = false;
+        if(peer->auth == this) purged.insert(end(purged), begin(peer->deferredPurges), end(peer->deferredPurges));
+        else if(peer->auth) peer->auth->PurgeReferencesToObjects(peer->deferredPurges);
+        peer->deferredPurges.clear();
+    }
+    PurgeReferencesToObjects(purged);
 }
 
 //////////////
@@ -107,16 +231,26 @@ void NCauthority::PublishFrame()
 //////////////
 
 LocalObject::LocalObject(NCauthority * auth, const NCclass * cl) : 
-    auth(auth), cl(cl), constState(cl->constSizeInBytes), varStateOffset(auth->stateAlloc.Allocate(cl->varSizeInBytes)), isPublished(false) 
+    auth(auth), cl(cl), constState(cl->constSizeInBytes), varStateOffset(auth->stateAlloc.Allocate(cl->varSizeInBytes)), priority(cl->priority), isPublished(false) 
 {
 
 }
 
+LocalObject::~LocalObject()
+{
+    if(auth) for(auto field : cl->constBlobs) auth->blobs.ReleaseRefs(reinterpret_cast<const int *>(constState.data() + field->dataOffset), 1);
+}
+
 int LocalObject::GetInt(const NCint * field) const
 {
     if(field->cl != cl) return 0;
-    if(!field->isConst) return reinterpret_cast<const int &>(auth->state[varStateOffset + field->dataOffset]);
-    return reinterpret_cast<const int &>(constState[field->dataOffset]);
+    return field->GetValue(field->isConst ? constState.data() : auth->state.data() + varStateOffset);
+}
+
+int64_t LocalObject::GetInt64(const NCint64 * field) const
+{
+    if(field->cl != cl) return 0;
+    return field->GetValue(field->isConst ? constState.data() : auth->state.data() + varStateOffset);
 }
 
 const NCobject * LocalObject::GetRef(const NCref * field) const
@@ -125,16 +259,37 @@ const NCobject * LocalObject::GetRef(const NCref * field) const
     return reinterpret_cast<const NCobject * const &>(auth->state[varStateOffset + field->dataOffset]);
 }
 
+const std::vector<uint8_t> & LocalObject::GetBytes(const NCbytes * field) const
+{
+    if(field->cl != cl) return auth->blobs.Get(0);
+    return auth->blobs.Get(reinterpret_cast<const int &>(field->isConst ? constState[field->dataOffset] : auth->state[varStateOffset + field->dataOffset]));
+}
+
+int LocalObject::GetArray(const NCarray * field, int * values) const
+{
+    if(field->cl != cl) return 0;
+    auto data = field->isConst ? constState.data() : auth->state.data() + varStateOffset;
+    if(values) std::copy(field->GetElements(data), field->GetElements(data) + field->GetLength(data), values);
+    return field->GetLength(data);
+}
+
 void LocalObject::SetVisibility(NCpeer * peer, bool isVisible) const
 {
     peer->local.SetVisibility(this, isVisible); 
 }
 
 void LocalObject::SetInt(const NCint * field, int value)
+{ 
+    if(field->cl != cl || (field->numValues && (value < 0 || value >= field->numValues))) return;
+    if(!field->isConst) field->SetValue(auth->state.data() + varStateOffset, value); 
+    else if(!isPublished) field->SetValue(constState.data(), value);
+}
+
+void LocalObject::SetInt64(const NCint64 * field, int64_t value)
 { 
     if(field->cl != cl) return;
-    if(!field->isConst) reinterpret_cast<int &>(auth->state[varStateOffset + field->dataOffset]) = value; 
-    else if(!isPublished) reinterpret_cast<int &>(constState[field->dataOffset]) = value;
+    if(!field->isConst) field->SetValue(auth->state.data() + varStateOffset, value); 
+    else if(!isPublished) field->SetValue(constState.data(), value);
 }
 
 void LocalObject::SetRef(const NCref * field, const NCobject * value)
@@ -143,6 +298,25 @@ void LocalObject::SetRef(const NCref * field, const NCobject * value)
     reinterpret_cast<const NCobject * &>(auth->state[varStateOffset + field->dataOffset]) = value; 
 }
 
+void LocalObject::SetBytes(const NCbytes * field, const void * data, int size)
+{
+    if(field->cl != cl || size < 0 || size > field->maxSize || (field->isConst && isPublished)) return;
+    auto & value = reinterpret_cast<int &>(field->isConst ? constState[field->dataOffset] : auth->state[varStateOffset + field->dataOffset]);
+    int handle = auth->blobs.Intern(reinterpret_cast<const uint8_t *>(data), size);
+    auth->blobs.AddRefs(&handle, 1);
+    auth->blobs.ReleaseRefs(&value, 1);
+    value = handle;
+}
+
+void LocalObject::SetArray(const NCarray * field, const int * values, int length)
+{
+    if(field->cl != cl || length < 0 || length > field->capacity || (field->isConst && isPublished)) return;
+    auto data = field->isConst ? constState.data() : auth->state.data() + varStateOffset;
+    reinterpret_cast<int &>(data[field->dataOffset]) = length;
+    std::copy(values, values + length, field->GetElements(data));
+    std::fill(field->GetElements(data) + length, field->GetElements(data) + field->capacity, 0); // Unused elements are zeroed so that they do not affect comparisons of state
+}
+
 void LocalObject::Destroy()
 { 
     if(cl->isEvent)
@@ -159,10 +333,13 @@ void LocalObject::Destroy()
     else
     {
         auth->PurgeReferencesToObject(this);
+        for(auto field : cl->varBlobs) auth->blobs.ReleaseRefs(reinterpret_cast<const int *>(auth->state.data() + varStateOffset + field->dataOffset), 1);
+        std::fill(begin(auth->state) + varStateOffset, begin(auth->state) + varStateOffset + cl->varSizeInBytes, 0); // Objects which reuse this range do not inherit handles whose references were released
         auth->stateAlloc.Free(varStateOffset, cl->varSizeInBytes);
         for(auto peer : auth->peers) peer->local.SetVisibility(this, false);
         Erase(auth->objects, this);
-        delete this; 
+        if(auth->IsProducingMessages()) auth->destroyedObjects.push_back(this); // Messages being produced in the background may still refer to this object
+        else delete this; 
     }
 }
 
@@ -170,7 +347,7 @@ void LocalObject::Destroy()
 // NCpeer //
 ////////////
 
-NCpeer::NCpeer(NCauthority * auth) : auth(auth), local(auth), remote(auth->protocol)
+NCpeer::NCpeer(NCauthority * auth) : auth(auth), local(auth), remote(auth->protocol), isDeferringPurges(false)
 {
 
 }
@@ -179,6 +356,7 @@ NCpeer::~NCpeer()
 {
     if(auth)
     {
+        auth->WaitForMessages();
         auto it = std::find(begin(auth->peers), end(auth->peers), this);
         if(it != end(auth->peers)) auth->peers.erase(it);
     }
@@ -191,20 +369,26 @@ int NCpeer::GetNetId(const NCobject * object, int frame) const
     return 0;                                                           // Otherwise, send a 0, to indicate nullptr
 }
 
+void NCpeer::PurgeReferencesToView(NCobject * view)
+{
+    if(isDeferringPurges) deferredPurges.push_back(view);
+    else if(auth) auth->PurgeReferencesToObject(view);
+}
+
 
-std::vector<uint8_t> NCpeer::ProduceMessage()
+std::vector<std::vector<uint8_t>> NCpeer::ProduceMessage()
 { 
-    if(!auth) return {};
-
-    std::vector<uint8_t> buffer;
-    ArithmeticEncoder encoder(buffer);
-    remote.ProduceResponse(encoder);
-    local.ProduceUpdate(encoder, this);
-    encoder.Finish();
-    return buffer;
+    if(!auth) return {{}};
+    return local.ProduceUpdate(this); // Each part of the update also carries our response to the remote peer's updates
 }
 
 void NCpeer::ConsumeMessage(const void * data, int size)
+{ 
+    if(auth) auth->WaitForMessages();
+    DecodeMessage(data, size);
+}
+
+void NCpeer::DecodeMessage(const void * data, int size)
 { 
     auto bytes = reinterpret_cast<const uint8_t *>(data);
     std::vector<uint8_t> buffer(bytes, bytes+size);
@@ -10,9 +10,15 @@
 
 using namespace netcode;
 
-NCint::NCint(NCclass * cl, int flags) : cl(cl), isConst(flags & NC_CONST_FIELD_FLAG)
+NCint::NCint(NCclass * cl, int flags, int numValues) : cl(cl), isConst(flags & NC_CONST_FIELD_FLAG), numValues(numValues), vec(), contextField(), maxValue()
 { 
-    if(isConst)
+    if(numValues)
+    {
+        uniqueId = isConst ? cl->protocol->numConstEnums++ : cl->protocol->numVarEnums++;
+        dataOffset = cl->AllocateByte(isConst);
+        (isConst ? cl->constEnums : cl->varEnums).push_back(this);
+    }
+    else if(isConst)
     {
         uniqueId = cl->protocol->numIntConstants++;
         dataOffset = cl->constSizeInBytes;
@@ -28,70 +34,365 @@ NCint::NCint(NCclass * cl, int flags) : cl(cl), isConst(flags & NC_CONST_FIELD_F
     }
 }
 
+NCint::NCint(const NCvec * vec, size_t component) : cl(vec->cl), isConst(false), numValues(0), uniqueId(vec->uniqueId), dataOffset(vec->dataOffset + component*sizeof(int32_t)), vec(vec), contextField(), maxValue()
+{
+
+}
+
+void NCint::SetContextField(const NCint * field)
+{
+    if(isConst || numValues || vec || field->isConst || field->numValues || field->vec || field->cl != cl) return;
+    if(!contextField)
+    {
+        // Allocate distributions for the remaining contexts
+        contextIds[0] = uniqueId;
+        for(size_t i=1; i<numFieldContexts; ++i) contextIds[i] = cl->protocol->numIntFields++;
+    }
+    contextField = field;
+}
+
+NCint64::NCint64(NCclass * cl, int flags) : cl(cl), isConst(flags & NC_CONST_FIELD_FLAG), uniqueId(cl->protocol->numInt64Fields++)
+{
+    auto & size = isConst ? cl->constSizeInBytes : cl->varSizeInBytes;
+    dataOffset = size;
+    size += sizeof(int64_t);
+    (isConst ? cl->constInt64s : cl->varInt64s).push_back(this);
+}
+
+NCfloat::NCfloat(NCclass * cl, float minValue, float maxValue, float precision, int flags) : field(cl, flags), minValue(minValue), maxValue(maxValue), precision(precision), maxStep(static_cast<int>(std::ceil((maxValue - minValue) / precision)))
+{
+    field.maxValue = maxStep;
+}
+
+int NCfloat::Quantize(float value) const
+{
+    const float step = std::round((value - minValue) / precision);
+    if(step <= 0) return 0;
+    if(step >= maxStep - 1 && maxValue - value <= value - Dequantize(maxStep - 1)) return maxStep; // The last step may be shorter than precision
+    return std::min(static_cast<int>(step), maxStep);
+}
+
+NCvec::NCvec(NCclass * cl, int components, int flags) : cl(cl), isConst(flags & NC_CONST_FIELD_FLAG), uniqueId(), dataOffset(), firstPrediction()
+{
+    if(isConst)
+    {
+        for(int i=0; i<components; ++i) this->components.emplace_back(new NCint(cl, flags));
+        for(auto & component : this->components) component->vec = this;
+    }
+    else
+    {
+        uniqueId = cl->protocol->numVarVecs++;
+        dataOffset = cl->varSizeInBytes;
+        firstPrediction = cl->varVecComponents;
+        cl->varSizeInBytes += components * sizeof(int32_t);
+        cl->varVecComponents += components;
+        for(int i=0; i<components; ++i) this->components.emplace_back(new NCint(this, i));
+        cl->varVecs.push_back(this);
+    }
+}
+
+NCbytes::NCbytes(NCclass * cl, int maxSize, int flags) : cl(cl), isConst(flags & NC_CONST_FIELD_FLAG), maxSize(maxSize), uniqueId(cl->protocol->numBlobFields++)
+{
+    auto & size = isConst ? cl->constSizeInBytes : cl->varSizeInBytes;
+    dataOffset = size;
+    size += sizeof(int32_t);
+    (isConst ? cl->constBlobs : cl->varBlobs).push_back(this);
+}
+
+NCarray::NCarray(NCclass * cl, int capacity, int flags) : cl(cl), isConst(flags & NC_CONST_FIELD_FLAG), capacity(capacity), uniqueId(cl->protocol->numArrayFields++)
+{
+    auto & size = isConst ? cl->constSizeInBytes : cl->varSizeInBytes;
+    dataOffset = size;
+    size += (capacity + 1) * sizeof(int32_t);
+    (isConst ? cl->constArrays : cl->varArrays).push_back(this);
+}
+
 NCref::NCref(NCclass * cl) : cl(cl), dataOffset(cl->varSizeInBytes)
 {
     cl->varSizeInBytes += std::max(sizeof(void *), sizeof(int)); // We will store pointers to objects on the "server" and integer IDs on the "client"
     cl->varRefs.push_back(this);
 }
 
-NCclass::NCclass(NCprotocol * protocol, bool isEvent) : protocol(protocol), isEvent(isEvent), uniqueId(isEvent ? protocol->eventClasses.size() : protocol->objectClasses.size()), constSizeInBytes(0), varSizeInBytes(0)
+NCclass::NCclass(NCprotocol * protocol, bool isEvent) : protocol(protocol), isEvent(isEvent), uniqueId(isEvent ? protocol->eventClasses.size() : protocol->objectClasses.size()), priority(1), constSizeInBytes(0), varSizeInBytes(0), constBytesEnd(0), varBytesEnd(0), varVecComponents(0)
 {
     if(isEvent) protocol->eventClasses.push_back(this);
     else protocol->objectClasses.push_back(this);
 }
 
-NCprotocol::NCprotocol(int maxFrameDelta) : maxFrameDelta(maxFrameDelta), numIntFields(0), numIntConstants(0)
+size_t NCclass::AllocateByte(bool isConst)
+{
+    // Byte-sized fields are packed four to a word, so that word-sized fields remain aligned
+    auto & size = isConst ? constSizeInBytes : varSizeInBytes;
+    auto & end = isConst ? constBytesEnd : varBytesEnd;
+    if(end % sizeof(int32_t) == 0)
+    {
+        end = size;
+        size += sizeof(int32_t);
+    }
+    return end++;
+}
+
+NCprotocol::NCprotocol(int maxFrameDelta) : maxFrameDelta(maxFrameDelta), ackWindow(std::max(std::min(maxFrameDelta, 8), 0)), predictorWarmup(0), sampleCandidates(6), numIntFields(0), numIntConstants(0), numInt64Fields(0), numVarEnums(0), numConstEnums(0), numVarVecs(0), numBlobFields(0), numArrayFields(0)
 {
     
 }
 
+NCprotocol::~NCprotocol()
+{
+    for(auto cl : objectClasses) delete cl;
+    for(auto cl : eventClasses) delete cl;
+}
+
 //////////////
 // Distribs //
 //////////////
 
-Distribs::Distribs()
+Distribs::Distribs() : blobsAdded(0)
 {
 
 }
 
 Distribs::Distribs(const NCprotocol & protocol) : 
-    intFieldDists(protocol.numIntFields), intConstDists(protocol.numIntConstants), objectClassDist(protocol.objectClasses.size()), eventClassDist(protocol.eventClasses.size()) 
+    intFieldDists(protocol.numIntFields), intConstDists(protocol.numIntConstants), int64Dists(protocol.numInt64Fields), varEnumDists(protocol.numVarEnums), constEnumDists(protocol.numConstEnums), vecDists(protocol.numVarVecs), arrayDists(protocol.numArrayFields), blobFieldDists(protocol.numBlobFields, SymbolDistribution(3)), blobsAdded(0), blobByteDist(256), objectClassDist(protocol.objectClasses.size()), eventClassDist(protocol.eventClasses.size()), partialUpdateDist(2), deferredObjectDist(2), splitMessageDist(2)
 {
+    for(auto cl : protocol.objectClasses) for(auto field : cl->varFields)
+    {
+        intFieldDists[field->uniqueId] = FieldDistribution(field->predictors.size(), protocol.predictorWarmup);
+        if(field->contextField) for(auto id : field->contextIds) intFieldDists[id] = intFieldDists[field->uniqueId];
+    }
+    for(auto cl : protocol.objectClasses) for(auto field : cl->varEnums) varEnumDists[field->uniqueId] = EnumDistribution(field->numValues);
+    for(auto cl : protocol.objectClasses) for(auto vec : cl->varVecs) vecDists[vec->uniqueId] = VecDistribution(vec->components.size());
+    for(auto classes : {&protocol.objectClasses, &protocol.eventClasses}) for(auto cl : *classes) for(auto field : cl->constEnums) constEnumDists[field->uniqueId] = SymbolDistribution(field->numValues);
+}
+
+void Distribs::Accumulate(const Distribs & base, const Distribs & part)
+{
+    for(size_t i=0; i<intFieldDists.size(); ++i) intFieldDists[i].Accumulate(base.intFieldDists[i], part.intFieldDists[i]);
+    for(size_t i=0; i<intConstDists.size(); ++i) intConstDists[i].Accumulate(base.intConstDists[i], part.intConstDists[i]);
+    for(size_t i=0; i<int64Dists.size(); ++i) int64Dists[i].Accumulate(base.int64Dists[i], part.int64Dists[i]);
+    for(size_t i=0; i<varEnumDists.size(); ++i) varEnumDists[i].Accumulate(base.varEnumDists[i], part.varEnumDists[i]);
+    for(size_t i=0; i<constEnumDists.size(); ++i) constEnumDists[i].Accumulate(base.constEnumDists[i], part.constEnumDists[i]);
+    for(size_t i=0; i<vecDists.size(); ++i) vecDists[i].Accumulate(base.vecDists[i], part.vecDists[i]);
+    for(size_t i=0; i<arrayDists.size(); ++i) arrayDists[i].Accumulate(base.arrayDists[i], part.arrayDists[i]);
+    for(size_t i=0; i<blobFieldDists.size(); ++i) blobFieldDists[i].Accumulate(base.blobFieldDists[i], part.blobFieldDists[i]);
+    // Append the blobs which part added to its dictionary, of which only the most recent may have been retained
+    const int added = part.blobsAdded - base.blobsAdded, retained = std::min(added, int(part.blobDictionary.size()));
+    for(size_t i=part.blobDictionary.size() - retained; i<part.blobDictionary.size(); ++i) AddToBlobDictionary(part.blobDictionary[i]);
+    blobsAdded += added - retained;
+    blobRecencyDist.Accumulate(base.blobRecencyDist, part.blobRecencyDist);
+    blobSizeDist.Accumulate(base.blobSizeDist, part.blobSizeDist);
+    blobByteDist.Accumulate(base.blobByteDist, part.blobByteDist);
+    eventCountDist.Accumulate(base.eventCountDist, part.eventCountDist);
+    newObjectCountDist.Accumulate(base.newObjectCountDist, part.newObjectCountDist);
+    delObjectCountDist.Accumulate(base.delObjectCountDist, part.delObjectCountDist);
+    delGapDist.Accumulate(base.delGapDist, part.delGapDist);
+    delRunDist.Accumulate(base.delRunDist, part.delRunDist);
+    uniqueIdDist.Accumulate(base.uniqueIdDist, part.uniqueIdDist);
+    newIdDist.Accumulate(base.newIdDist, part.newIdDist);
+    objectClassDist.Accumulate(base.objectClassDist, part.objectClassDist);
+    eventClassDist.Accumulate(base.eventClassDist, part.eventClassDist);
+    partialUpdateDist.Accumulate(base.partialUpdateDist, part.partialUpdateDist);
+    deferredObjectDist.Accumulate(base.deferredObjectDist, part.deferredObjectDist);
+    splitMessageDist.Accumulate(base.splitMessageDist, part.splitMessageDist);
+}
+
+void Distribs::AddToBlobDictionary(int handle)
+{
+    blobDictionary.push_back(handle);
+    if(blobDictionary.size() > maxBlobDictionary) blobDictionary.erase(begin(blobDictionary));
+    ++blobsAdded;
+}
 
+float Distribs::GetBlobCost(const NCbytes & field, int handle, int prevHandle, const BlobTable & blobs) const
+{
+    auto & dist = blobFieldDists[field.uniqueId];
+    if(handle == prevHandle) return -log2(dist.GetProbability(0));
+    auto it = std::find(blobDictionary.rbegin(), blobDictionary.rend(), handle);
+    if(it != blobDictionary.rend()) return -log2(dist.GetProbability(1)) + blobRecencyDist.GetCost(it - blobDictionary.rbegin());
+    auto size = blobs.Get(handle).size();
+    return -log2(dist.GetProbability(2)) + blobSizeDist.GetCost(size) + size * 8;
 }
 
-void Distribs::EncodeAndTallyObjectConstants(ArithmeticEncoder & encoder, const NCclass & cl, const std::vector<uint8_t> & state)
+void Distribs::EncodeAndTallyBlob(ArithmeticEncoder & encoder, const NCbytes & field, int handle, int prevHandle, const BlobTable & blobs)
+{
+    // Blobs which are unchanged, or which were recently sent in any field, are sent as a reference rather than in full
+    auto & dist = blobFieldDists[field.uniqueId];
+    if(handle == prevHandle) return dist.EncodeAndTally(encoder, 0);
+    auto it = std::find(blobDictionary.rbegin(), blobDictionary.rend(), handle);
+    if(it != blobDictionary.rend())
+    {
+        dist.EncodeAndTally(encoder, 1);
+        blobRecencyDist.EncodeAndTally(encoder, it - blobDictionary.rbegin());
+        return;
+    }
+    dist.EncodeAndTally(encoder, 2);
+    auto & blob = blobs.Get(handle);
+    blobSizeDist.EncodeAndTally(encoder, blob.size());
+    for(auto b : blob) blobByteDist.EncodeAndTally(encoder, b);
+    if(handle != 0) AddToBlobDictionary(handle);
+}
+
+int Distribs::DecodeAndTallyBlob(ArithmeticDecoder & decoder, const NCbytes & field, int prevHandle, BlobTable & blobs)
+{
+    switch(blobFieldDists[field.uniqueId].DecodeAndTally(decoder))
+    {
+    case 0: return std::max(prevHandle, 0);
+    case 1:
+        {
+            size_t recency = blobRecencyDist.DecodeAndTally(decoder);
+            return recency < blobDictionary.size() ? blobDictionary.rbegin()[recency] : 0;
+        }
+    default:
+        {
+            std::vector<uint8_t> blob(std::max(std::min(blobSizeDist.DecodeAndTally(decoder), field.maxSize), 0));
+            for(auto & b : blob) b = static_cast<uint8_t>(blobByteDist.DecodeAndTally(decoder));
+            int handle = blobs.Intern(blob.data(), blob.size());
+            if(handle != 0) AddToBlobDictionary(handle);
+            return handle;
+        }
+    }
+}
+
+void Distribs::EncodeAndTallyDeletions(ArithmeticEncoder & encoder, const std::vector<int> & indices)
+{
+    // Objects tend to be destroyed in contiguous groups, so deleted indices are sent as runs, each preceded by the number of objects skipped since the last run (which is at least one after the first run)
+    delObjectCountDist.EncodeAndTally(encoder, indices.size());
+    int next = 0;
+    for(size_t i=0; i<indices.size(); )
+    {
+        int run = 1;
+        while(i + run < indices.size() && indices[i + run] == indices[i] + run) ++run;
+        delGapDist.EncodeAndTally(encoder, indices[i] - next - (i > 0 ? 1 : 0));
+        delRunDist.EncodeAndTally(encoder, run - 1);
+        next = indices[i] + run;
+        i += run;
+    }
+}
+
+std::vector<int> Distribs::DecodeAndTallyDeletions(ArithmeticDecoder & decoder, size_t numPrevObjects)
+{
+    std::vector<int> indices;
+    for(int remaining = delObjectCountDist.DecodeAndTally(decoder), next = 0; remaining > 0; )
+    {
+        int index = next + delGapDist.DecodeAndTally(decoder) + (indices.empty() ? 0 : 1), run = delRunDist.DecodeAndTally(decoder) + 1;
+        if(index < next || run < 1 || run > remaining || static_cast<size_t>(index + run) > numPrevObjects) break; // Malformed packet
+        for(int i=0; i<run; ++i) indices.push_back(index + i);
+        remaining -= run;
+        next = index + run;
+    }
+    return indices;
+}
+
+void Distribs::EncodeAndTallyObjectConstants(ArithmeticEncoder & encoder, const NCclass & cl, const std::vector<uint8_t> & state, const BlobTable & blobs)
 {
     for(auto field : cl.constFields)
 	{
         intConstDists[field->uniqueId].EncodeAndTally(encoder, reinterpret_cast<const int &>(state[field->dataOffset]));
 	}    
+    const int64_t zero = 0;
+    for(auto field : cl.constInt64s) int64Dists[field->uniqueId].EncodeAndTally(encoder, field->GetValue(state.data()), &zero, 0);
+    for(auto field : cl.constEnums) constEnumDists[field->uniqueId].EncodeAndTally(encoder, state[field->dataOffset]);
+    for(auto field : cl.constBlobs) EncodeAndTallyBlob(encoder, *field, reinterpret_cast<const int &>(state[field->dataOffset]), -1, blobs);
+    for(auto field : cl.constArrays) arrayDists[field->uniqueId].EncodeAndTally(encoder, field->GetElements(state.data()), field->GetLength(state.data()), nullptr, -1);
 }
 
-std::vector<uint8_t> Distribs::DecodeAndTallyObjectConstants(ArithmeticDecoder & decoder, const NCclass & cl)
+std::vector<uint8_t> Distribs::DecodeAndTallyObjectConstants(ArithmeticDecoder & decoder, const NCclass & cl, BlobTable & blobs)
 {
     std::vector<uint8_t> state(cl.constSizeInBytes);
     for(auto field : cl.constFields)
 	{
         reinterpret_cast<int &>(state[field->dataOffset]) = intConstDists[field->uniqueId].DecodeAndTally(decoder);
     }
+    const int64_t zero = 0;
+    for(auto field : cl.constInt64s) field->SetValue(state.data(), int64Dists[field->uniqueId].DecodeAndTally(decoder, &zero, 0));
+    for(auto field : cl.constEnums) state[field->dataOffset] = static_cast<uint8_t>(constEnumDists[field->uniqueId].DecodeAndTally(decoder));
+    for(auto field : cl.constBlobs) reinterpret_cast<int &>(state[field->dataOffset]) = DecodeAndTallyBlob(decoder, *field, -1, blobs);
+    for(auto field : cl.constArrays) reinterpret_cast<int &>(state[field->dataOffset]) = arrayDists[field->uniqueId].DecodeAndTally(decoder, field->GetElements(state.data()), field->capacity, nullptr, -1);
     return state;
 }
 
-Frameset::Frameset(const std::vector<int> & frames, const std::map<int, std::vector<uint8_t>> & frameStates) : frame(frames[0])
+Frameset::Frameset(const NCprotocol & protocol, const std::vector<int> & frames, const std::map<int, std::vector<uint8_t>> & frameStates, const std::map<int, std::vector<uint8_t>> * peerStates) : frame(frames[0])
 {
     for(size_t i=0; i<4; ++i)
     {
         prevFrames[i] = i+1 < frames.size() ? frames[i+1] : 0;
         auto it = frameStates.find(prevFrames[i]);
         prevStates[i] = it != end(frameStates) ? it->second.data() : nullptr;
+        if(!peerStates) continue;
+        it = peerStates->find(prevFrames[i]);
+        if(it != end(*peerStates)) prevStates[i] = it->second.data(); // Frames in which some updates were deferred differ from the authority's state
+    }
+
+    int frameDeltas[4];
+    for(int i=0; i<4; ++i) frameDeltas[i] = prevFrames[i] != 0 ? frame - prevFrames[i] : 0;
+    protocol.predictorCache.GetPredictors(frameDeltas, predictors);
+}
+
+void Frameset::PredictCustom(const NCint & field, int stateOffset, int sampleCount, const uint8_t * state, int * predictions) const
+{
+    if(field.predictors.empty()) return;
+    NCsamples samples = {&field, state + stateOffset};
+    for(int i=0; i<sampleCount; ++i)
+    {
+        samples.prevStates[i] = prevStates[i] + stateOffset;
+        samples.frameDeltas[i] = frame - prevFrames[i];
     }
+    samples.sampleCount = sampleCount;
+    for(size_t i=0; i<field.predictors.size(); ++i) predictions[i] = field.predictors[i].first(&samples, field.predictors[i].second);
+}
+
+size_t Frameset::GetFieldDistribution(const NCint & field, int stateOffset, int sampleCount, const uint8_t * state) const
+{
+    if(!field.contextField) return field.uniqueId;
 
-    predictors[0] = CurvePredictor();
-    predictors[1] = prevFrames[0] != 0 ? MakeConstantPredictor() : predictors[0];
-    predictors[2] = prevFrames[1] != 0 ? MakeLinearPredictor(frame-prevFrames[0], frame-prevFrames[1]) : predictors[1];
-    predictors[3] = prevFrames[2] != 0 ? MakeQuadraticPredictor(frame-prevFrames[0], frame-prevFrames[1], frame-prevFrames[2]) : predictors[1];
-    predictors[4] = prevFrames[3] != 0 ? MakeCubicPredictor(frame-prevFrames[0], frame-prevFrames[1], frame-prevFrames[2], frame-prevFrames[3]) : predictors[1];
+    // The context is the motion of the context field on this frame if it has already been decoded, or on the previous frame otherwise
+    const int offset = stateOffset + field.contextField->dataOffset;
+    int64_t motion;
+    if(field.contextField->dataOffset < field.dataOffset && sampleCount >= 1) motion = int64_t(reinterpret_cast<const int &>(state[offset])) - reinterpret_cast<const int &>(prevStates[0][offset]);
+    else if(sampleCount >= 2) motion = int64_t(reinterpret_cast<const int &>(prevStates[0][offset])) - reinterpret_cast<const int &>(prevStates[1][offset]);
+    else return field.contextIds[0];
+    if(motion < 0) motion = -motion;
+    return field.contextIds[motion == 0 ? 1 : motion <= 16 ? 2 : 3];
+}
+
+int NCsamples::GetInt(int sample, const NCint * field) const
+{
+    // Fields which follow the predicted field on the current frame have not yet been decoded by the remote peer, and must be ignored
+    if(field->cl != this->field->cl || field->isConst || sample < 0 || sample > sampleCount) return 0;
+    if(sample == 0) return !field->numValues && field->dataOffset < this->field->dataOffset ? reinterpret_cast<const int &>(state[field->dataOffset]) : 0; // Enum fields are decoded after all integer fields
+    return field->GetValue(prevStates[sample-1]);
+}
+
+const int * Frameset::PredictFields(const NCclass & cl, int stateOffset, int sampleCount) const
+{
+    // Gather the previous values of every field, one row per sample, so that each predictor can be evaluated across all fields in a single loop
+    const size_t n = cl.GetPredictedCount();
+    scratch.resize(n * 9);
+    int * samples[4] = {scratch.data(), scratch.data() + n, scratch.data() + n*2, scratch.data() + n*3}, * predictions = scratch.data() + n*4;
+    for(int i=0; i<4; ++i)
+    {
+        int * row = samples[i];
+        if(i >= sampleCount) { std::fill(row, row + n, 0); continue; }
+        for(auto field : cl.varFields) *row++ = reinterpret_cast<const int &>(prevStates[i][stateOffset + field->dataOffset]);
+        for(auto vec : cl.varVecs) for(auto & c : vec->components) *row++ = reinterpret_cast<const int &>(prevStates[i][stateOffset + c->dataOffset]);
+    }
+
+    // Most frame deltas yield integer coefficients, in which case the loop is free of divisions and can be vectorized by the compiler
+    for(int i=0; i<=sampleCount; ++i)
+    {
+        const auto & p = predictors[i];
+        int * out = predictions + i*n;
+        if(p.denom == 1) for(size_t j=0; j<n; ++j) out[j] = static_cast<int>(p.c0*samples[0][j] + p.c1*samples[1][j] + p.c2*samples[2][j] + p.c3*samples[3][j]);
+        else for(size_t j=0; j<n; ++j) out[j] = static_cast<int>((p.c0*samples[0][j] + p.c1*samples[1][j] + p.c2*samples[2][j] + p.c3*samples[3][j]) / p.denom);
+    }
+    return predictions;
+}
+
+void Frameset::PredictInt64(const NCint64 & field, int stateOffset, int sampleCount, int64_t (&predictions)[5]) const
+{
+    int64_t samples[4] = {};
+    for(int i=0; i<sampleCount; ++i) samples[i] = field.GetValue(prevStates[i] + stateOffset);
+    for(int i=0; i<=sampleCount; ++i) predictions[i] = predictors[i](samples);
 }
 
 int Frameset::GetSampleCount(int frameAdded) const 
@@ -103,16 +404,95 @@ int Frameset::GetSampleCount(int frameAdded) const
     return 0; 
 }
 
+float Frameset::GetObjectCost(const Distribs & distribs, const NCclass & cl, int stateOffset, int frameAdded, const uint8_t * state, const NCpeer & peer) const
+{
+    const int sampleCount = GetSampleCount(frameAdded);
+    float cost = 0;
+    const int * curvePredictions = PredictFields(cl, stateOffset, sampleCount);
+    const size_t n = cl.GetPredictedCount();
+    for(size_t j=0; j<cl.varFields.size(); ++j)
+	{
+        auto field = cl.varFields[j];
+        int offset = stateOffset + field->dataOffset, predictions[5 + maxFieldPredictors];
+        for(int i=0; i<=sampleCount; ++i) predictions[i] = field->ClampPrediction(curvePredictions[i*n + j]);
+        PredictCustom(*field, stateOffset, sampleCount, state, predictions + 5);
+		cost += distribs.intFieldDists[GetFieldDistribution(*field, stateOffset, sampleCount, state)].GetCost(reinterpret_cast<const int &>(state[offset]), predictions, sampleCount);
+	}    
+
+    for(auto vec : cl.varVecs)
+    {
+        auto values = reinterpret_cast<const int *>(state + stateOffset + vec->dataOffset);
+        cost += distribs.vecDists[vec->uniqueId].GetCost(values, vec->components.size(), curvePredictions + cl.varFields.size() + vec->firstPrediction, n, sampleCount);
+    }
+
+    for(auto field : cl.varInt64s)
+    {
+        int64_t predictions[5];
+        PredictInt64(*field, stateOffset, sampleCount, predictions);
+        cost += distribs.int64Dists[field->uniqueId].GetCost(field->GetValue(state + stateOffset), predictions, sampleCount);
+    }
+
+    for(auto field : cl.varEnums)
+    {
+        auto offset = stateOffset + field->dataOffset;
+        cost += distribs.varEnumDists[field->uniqueId].GetCost(state[offset], sampleCount ? prevStates[0][offset] : -1);
+    }
+
+    for(auto field : cl.varRefs)
+    {
+        auto offset = stateOffset + field->dataOffset;
+        auto id = peer.GetNetId(reinterpret_cast<const NCobject * const &>(state[offset]), frame);
+        auto prevId = sampleCount ? peer.GetNetId(reinterpret_cast<const NCobject * const &>(prevStates[0][offset]), prevFrames[0]) : 0;
+        cost += distribs.uniqueIdDist.GetCost(id-prevId);
+    }
+
+    for(auto field : cl.varBlobs)
+    {
+        auto offset = stateOffset + field->dataOffset;
+        cost += distribs.GetBlobCost(*field, reinterpret_cast<const int &>(state[offset]), sampleCount ? reinterpret_cast<const int &>(prevStates[0][offset]) : -1, peer.auth->blobs);
+    }
+
+    for(auto field : cl.varArrays)
+    {
+        auto current = state + stateOffset, prev = sampleCount ? prevStates[0] + stateOffset : nullptr;
+        cost += distribs.arrayDists[field->uniqueId].GetCost(field->GetElements(current), field->GetLength(current), prev ? field->GetElements(prev) : nullptr, prev ? field->GetLength(prev) : -1);
+    }
+    return cost;
+}
+
 void Frameset::EncodeAndTallyObject(ArithmeticEncoder & encoder, netcode::Distribs & distribs, const NCclass & cl, int stateOffset, int frameAdded, const uint8_t * state, const NCpeer & peer) const
 {
     const int sampleCount = GetSampleCount(frameAdded);
-    for(auto field : cl.varFields)
+    const int * curvePredictions = PredictFields(cl, stateOffset, sampleCount);
+    const size_t n = cl.GetPredictedCount();
+    for(size_t j=0; j<cl.varFields.size(); ++j)
 	{
-        int offset = stateOffset + field->dataOffset, prevValues[4];
-        for(int i=0; i<4; ++i) prevValues[i] = sampleCount > i ? reinterpret_cast<const int &>(prevStates[i][offset]) : 0;
-		distribs.intFieldDists[field->uniqueId].EncodeAndTally(encoder, reinterpret_cast<const int &>(state[offset]), prevValues, predictors, sampleCount);
+        auto field = cl.varFields[j];
+        int offset = stateOffset + field->dataOffset, predictions[5 + maxFieldPredictors];
+        for(int i=0; i<=sampleCount; ++i) predictions[i] = field->ClampPrediction(curvePredictions[i*n + j]);
+        PredictCustom(*field, stateOffset, sampleCount, state, predictions + 5);
+		distribs.intFieldDists[GetFieldDistribution(*field, stateOffset, sampleCount, state)].EncodeAndTally(encoder, reinterpret_cast<const int &>(state[offset]), predictions, sampleCount);
 	}    
 
+    for(auto vec : cl.varVecs)
+    {
+        auto values = reinterpret_cast<const int *>(state + stateOffset + vec->dataOffset);
+        distribs.vecDists[vec->uniqueId].EncodeAndTally(encoder, values, vec->components.size(), curvePredictions + cl.varFields.size() + vec->firstPrediction, n, sampleCount);
+    }
+
+    for(auto field : cl.varInt64s)
+    {
+        int64_t predictions[5];
+        PredictInt64(*field, stateOffset, sampleCount, predictions);
+        distribs.int64Dists[field->uniqueId].EncodeAndTally(encoder, field->GetValue(state + stateOffset), predictions, sampleCount);
+    }
+
+    for(auto field : cl.varEnums)
+    {
+        auto offset = stateOffset + field->dataOffset;
+        distribs.varEnumDists[field->uniqueId].EncodeAndTally(encoder, state[offset], sampleCount ? prevStates[0][offset] : -1);
+    }
+
     for(auto field : cl.varRefs)
     {
         auto offset = stateOffset + field->dataOffset;
@@ -120,31 +500,91 @@ void Frameset::EncodeAndTallyObject(ArithmeticEncoder & encoder, netcode::Distri
         auto prevId = sampleCount ? peer.GetNetId(reinterpret_cast<const NCobject * const &>(prevStates[0][offset]), prevFrames[0]) : 0;
         distribs.uniqueIdDist.EncodeAndTally(encoder, id-prevId);
     }
+
+    for(auto field : cl.varBlobs)
+    {
+        auto offset = stateOffset + field->dataOffset;
+        distribs.EncodeAndTallyBlob(encoder, *field, reinterpret_cast<const int &>(state[offset]), sampleCount ? reinterpret_cast<const int &>(prevStates[0][offset]) : -1, peer.auth->blobs);
+    }
+
+    for(auto field : cl.varArrays)
+    {
+        auto current = state + stateOffset, prev = sampleCount ? prevStates[0] + stateOffset : nullptr;
+        distribs.arrayDists[field->uniqueId].EncodeAndTally(encoder, field->GetElements(current), field->GetLength(current), prev ? field->GetElements(prev) : nullptr, prev ? field->GetLength(prev) : -1);
+    }
 }
 
-void Frameset::DecodeAndTallyObject(ArithmeticDecoder & decoder, netcode::Distribs & distribs, const NCclass & cl, int stateOffset, int frameAdded, uint8_t * state) const
+void Frameset::DecodeAndTallyObject(ArithmeticDecoder & decoder, netcode::Distribs & distribs, const NCclass & cl, int stateOffset, int frameAdded, uint8_t * state, BlobTable & blobs) const
 {
     const int sampleCount = GetSampleCount(frameAdded);
-    for(auto field : cl.varFields)
+    const int * curvePredictions = PredictFields(cl, stateOffset, sampleCount);
+    const size_t n = cl.GetPredictedCount();
+    for(size_t j=0; j<cl.varFields.size(); ++j)
 	{
-        int offset = stateOffset + field->dataOffset, prevValues[4];
-        for(int i=0; i<4; ++i) prevValues[i] = sampleCount > i ? reinterpret_cast<const int &>(prevStates[i][offset]) : 0;
-		reinterpret_cast<int &>(state[offset]) = distribs.intFieldDists[field->uniqueId].DecodeAndTally(decoder, prevValues, predictors, sampleCount);
+        auto field = cl.varFields[j];
+        int offset = stateOffset + field->dataOffset, predictions[5 + maxFieldPredictors];
+        for(int i=0; i<=sampleCount; ++i) predictions[i] = field->ClampPrediction(curvePredictions[i*n + j]);
+        PredictCustom(*field, stateOffset, sampleCount, state, predictions + 5);
+		reinterpret_cast<int &>(state[offset]) = distribs.intFieldDists[GetFieldDistribution(*field, stateOffset, sampleCount, state)].DecodeAndTally(decoder, predictions, sampleCount);
 	}    
 
+    for(auto vec : cl.varVecs)
+    {
+        auto values = reinterpret_cast<int *>(state + stateOffset + vec->dataOffset);
+        distribs.vecDists[vec->uniqueId].DecodeAndTally(decoder, values, vec->components.size(), curvePredictions + cl.varFields.size() + vec->firstPrediction, n, sampleCount);
+    }
+
+    for(auto field : cl.varInt64s)
+    {
+        int64_t predictions[5];
+        PredictInt64(*field, stateOffset, sampleCount, predictions);
+        field->SetValue(state + stateOffset, distribs.int64Dists[field->uniqueId].DecodeAndTally(decoder, predictions, sampleCount));
+    }
+
+    for(auto field : cl.varEnums)
+    {
+        auto offset = stateOffset + field->dataOffset;
+        state[offset] = static_cast<uint8_t>(distribs.varEnumDists[field->uniqueId].DecodeAndTally(decoder, sampleCount ? prevStates[0][offset] : -1));
+    }
+
     for(auto field : cl.varRefs)
     {
         int offset = stateOffset + field->dataOffset;
         int prevId = sampleCount ? reinterpret_cast<const int &>(prevStates[0][offset]) : 0;
         reinterpret_cast<int &>(state[offset]) = prevId + distribs.uniqueIdDist.DecodeAndTally(decoder);
     }
+
+    for(auto field : cl.varBlobs)
+    {
+        int offset = stateOffset + field->dataOffset;
+        reinterpret_cast<int &>(state[offset]) = distribs.DecodeAndTallyBlob(decoder, *field, sampleCount ? reinterpret_cast<const int &>(prevStates[0][offset]) : -1, blobs);
+    }
+
+    for(auto field : cl.varArrays)
+    {
+        uint8_t * current = state + stateOffset; const uint8_t * prev = sampleCount ? prevStates[0] + stateOffset : nullptr;
+        reinterpret_cast<int &>(current[field->dataOffset]) = distribs.arrayDists[field->uniqueId].DecodeAndTally(decoder, field->GetElements(current), field->capacity, prev ? field->GetElements(prev) : nullptr, prev ? field->GetLength(prev) : -1);
+    }
+}
+
+int netcode::PredictUniqueId(const std::vector<int> & usedIds, int prevId)
+{
+    int id = prevId + 1;
+    for(auto it = std::lower_bound(begin(usedIds), end(usedIds), id); it != end(usedIds) && *it == id; ++it) ++id;
+    return id;
+}
+
+int netcode::ResolveFrame(code_t lowBits, int latestFrame)
+{
+    const code_t mask = (code_t(1) << frameBits) - 1;
+    return latestFrame - static_cast<int>((static_cast<code_t>(latestFrame) - lowBits) & mask);
 }
 
 void netcode::EncodeFramelist(ArithmeticEncoder & encoder, const int * frames, size_t numFrames, size_t maxFrames, int maxFrameDelta)
 {
     assert(numFrames <= maxFrames);
     EncodeUniform(encoder, numFrames, maxFrames+1);
-    if(numFrames) EncodeBits(encoder, frames[0], 32);
+    if(numFrames) EncodeBits(encoder, frames[0], numFrames > 1 ? frameBits : 32);
     for(size_t i=1; i<numFrames; ++i)
     {
         auto delta = frames[i-1] - frames[i];
@@ -153,11 +593,46 @@ void netcode::EncodeFramelist(ArithmeticEncoder & encoder, const int * frames, s
     }
 }
 
-std::vector<int> netcode::DecodeFramelist(ArithmeticDecoder & decoder, size_t maxFrames, int maxFrameDelta)
+void netcode::EncodeAcks(ArithmeticEncoder & encoder, const std::vector<int> & frames, int window)
+{
+    // Encode the newest frame, followed by a bitfield indicating which of the frames within the window preceding it are also present
+    EncodeUniform(encoder, !frames.empty(), 2);
+    if(frames.empty()) return;
+    EncodeBits(encoder, frames[0], frameBits);
+
+    // Losses come in bursts, so each bit is coded by an adaptive distribution selected by the previous bit. As responses may themselves be lost, 
+    // the distributions start afresh in every response.
+    SymbolDistribution bitDists[2] = {SymbolDistribution(2), SymbolDistribution(2)};
+    bool prevBit = true;
+    for(int i=1; i<=window; ++i)
+    {
+        const bool bit = std::find(begin(frames), end(frames), frames[0]-i) != end(frames);
+        bitDists[prevBit].EncodeAndTally(encoder, bit);
+        prevBit = bit;
+    }
+}
+
+std::vector<int> netcode::DecodeAcks(ArithmeticDecoder & decoder, int window, int latestFrame)
+{
+    std::vector<int> frames;
+    if(!DecodeUniform(decoder, 2)) return frames;
+    frames.push_back(ResolveFrame(DecodeBits(decoder, frameBits), latestFrame));
+    SymbolDistribution bitDists[2] = {SymbolDistribution(2), SymbolDistribution(2)};
+    bool prevBit = true;
+    for(int i=1; i<=window; ++i)
+    {
+        prevBit = bitDists[prevBit].DecodeAndTally(decoder) != 0;
+        if(prevBit) frames.push_back(frames[0]-i);
+    }
+    return frames;
+}
+
+std::vector<int> netcode::DecodeFramelist(ArithmeticDecoder & decoder, size_t maxFrames, int maxFrameDelta, int latestFrame)
 {
     std::vector<int> frames;
     size_t numFrames = DecodeUniform(decoder, maxFrames+1);    
-    if(numFrames) frames.push_back(DecodeBits(decoder, 32));
+    if(numFrames == 1) frames.push_back(DecodeBits(decoder, 32));
+    else if(numFrames) frames.push_back(ResolveFrame(DecodeBits(decoder, frameBits), latestFrame + maxFrameDelta)); // The previous frame was received by us, so the current frame cannot be much later than our newest frame
     for(size_t i=1; i<numFrames; ++i)
     {
         auto delta = DecodeUniform(decoder, maxFrameDelta+1);
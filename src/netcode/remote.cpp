@@ -22,29 +22,60 @@ struct RemoteSet::Object : public NCobject
     int frameAdded;
     std::vector<uint8_t> constState;
 	int varStateOffset;
+    bool isVisible;     // Whether this view is on the newest frame
+    bool isHidden;      // Whether this view was on the newest frame before the message being consumed, and may yet be placed on the frame it updates
+    bool isCreated;     // Whether this view was added to the newest frame by the most recently consumed message
+    int visibleFrame;   // Frame on which this view was most recently added to the newest frame
+    std::vector<uint8_t> lastState; // Variable state of a destroyed view on the newest frame before it was destroyed, as it is absent from every newer frame
+    BlobRefs lastBlobRefs;          // References to the blobs held by lastState, which may outlive the frame it was taken from
     
 	Object(NCpeer * peer, int uniqueId, const NCclass * cl, int frameAdded, std::vector<uint8_t> constState) : 
-        peer(peer), uniqueId(uniqueId), cl(cl), frameAdded(frameAdded), constState(move(constState)), varStateOffset(peer->remote.stateAlloc.Allocate(cl->varSizeInBytes)) {}
+        peer(peer), uniqueId(uniqueId), cl(cl), frameAdded(frameAdded), constState(move(constState)), varStateOffset(peer->remote.stateAlloc.Allocate(cl->varSizeInBytes)),
+        isVisible(), isHidden(), isCreated(), visibleFrame() { for(auto field : cl->constBlobs) peer->remote.blobs.AddRefs(reinterpret_cast<const int *>(this->constState.data() + field->dataOffset), 1); }
     ~Object()
     {
-        peer->auth->PurgeReferencesToObject(this);
+        for(auto field : cl->constBlobs) peer->remote.blobs.ReleaseRefs(reinterpret_cast<const int *>(constState.data() + field->dataOffset), 1);
+        peer->PurgeReferencesToView(this);
         peer->remote.stateAlloc.Free(varStateOffset, cl->varSizeInBytes);    
     }
 
     bool IsLive(int frame) const { return frameAdded <= frame; }
+    const uint8_t * GetVarState() const { return lastState.empty() ? peer->remote.latestState + varStateOffset : lastState.data(); }
     const NCclass * GetClass() const override { return cl; }
 
     int GetInt(const NCint * field) const override
     { 
         if(field->cl != cl) return 0;
-        if(field->isConst) return reinterpret_cast<const int &>(constState[field->dataOffset]); 
-        return reinterpret_cast<const int &>(peer->remote.frameStates.rbegin()->second[varStateOffset + field->dataOffset]); 
+        return field->GetValue(field->isConst ? constState.data() : GetVarState());
+    }
+
+    int64_t GetInt64(const NCint64 * field) const override
+    { 
+        if(field->cl != cl) return 0;
+        return field->GetValue(field->isConst ? constState.data() : GetVarState());
+    }
+
+    // Interpolates between the retained frames on either side of the given frame, or extrapolates beyond the newest frame
+    void GetIntsAt(const NCint * const * fields, int count, double frame, double * values) const override;
+
+    const std::vector<uint8_t> & GetBytes(const NCbytes * field) const override
+    {
+        if(field->cl != cl) return peer->remote.blobs.Get(0);
+        return peer->remote.blobs.Get(reinterpret_cast<const int &>((field->isConst ? constState.data() : GetVarState())[field->dataOffset]));
+    }
+
+    int GetArray(const NCarray * field, int * values) const override
+    {
+        if(field->cl != cl) return 0;
+        auto data = field->isConst ? constState.data() : GetVarState();
+        if(values) std::copy(field->GetElements(data), field->GetElements(data) + field->GetLength(data), values);
+        return field->GetLength(data);
     }
 
     const NCobject * GetRef(const NCref * field) const override
     { 
         if(field->cl != cl) return nullptr;
-        auto id = reinterpret_cast<const int &>(peer->remote.frameStates.rbegin()->second[varStateOffset + field->dataOffset]);
+        auto id = reinterpret_cast<const int &>(GetVarState()[field->dataOffset]);
         if(id > 0) return peer->remote.GetObjectFromUniqueId(id); // Positive IDs refer to other remote objects
         if(id < 0) return peer->local.GetObjectFromUniqueId(-id); // Negative IDs refer to our own local objects
         return nullptr;                                           // Zero refers to nullptr
@@ -53,32 +84,109 @@ struct RemoteSet::Object : public NCobject
 
 struct RemoteSet::Frame
 {
-    std::vector<std::shared_ptr<Object>> views;
-    Distribs distribs;
+    std::vector<std::shared_ptr<Object>> views;     // Views of all objects on this frame, which are null for newly created objects whose part of the message has not yet arrived
+    size_t missingViews;                            // Number of null entries in views
+    Distribs distribs;                              // Probability distributions at the end of this frame, or at the previous frame if some parts of the message have not yet arrived
+    size_t partCount;                               // Number of parts which the message for this frame was split into
+    std::map<size_t, Distribs> receivedParts;       // Probability distributions produced by each part received so far, cleared once all parts have arrived
+
+    bool IsComplete() const { return receivedParts.empty(); }
 };
 
-RemoteSet::~RemoteSet()
+void RemoteSet::Object::GetIntsAt(const NCint * const * fields, int count, double frame, double * values) const
 {
+    // Destroyed views are absent from the newest frame, and report their last values
+    if(!lastState.empty()) return NCobject::GetIntsAt(fields, count, frame, values);
+
+    // Only frames decoded since this view was created hold its state
+    auto & states = peer->remote.frameStates;
+    const auto first = states.lower_bound(frameAdded), newest = std::prev(end(states));
+    auto getValue = [&](const NCint * field, const std::vector<uint8_t> & state) { return field->GetValue(field->isConst ? constState.data() : state.data() + varStateOffset); };
+    if(frame < newest->first)
+    {
+        // Interpolate between the frames on either side, holding enum fields at the earlier value, and clamping to the frame on which this view was created
+        const auto hi = frame > first->first ? states.upper_bound(static_cast<int>(std::floor(frame))) : first, lo = hi == first ? first : std::prev(hi);
+        const double t = hi == lo ? 0 : (frame - lo->first) / (hi->first - lo->first);
+        for(int i=0; i<count; ++i)
+        {
+            if(fields[i]->cl != cl) { values[i] = 0; continue; }
+            const double a = getValue(fields[i], lo->second), b = getValue(fields[i], hi->second);
+            values[i] = fields[i]->numValues ? a : a + (b - a) * t;
+        }
+        return;
+    }
+
+    // Gather the most recent samples, and the weights with which the curves through them are evaluated at the requested frame. The weights are computed
+    // here rather than taken from the protocol's PredictorCache, as requested frames are arbitrary and would fill the cache with predictors used only once.
+    int sampleCount = 0, sampleFrames[4];
+    const std::vector<uint8_t> * sampleStates[4];
+    for(auto it = newest; sampleCount < 4; --it)
+    {
+        sampleFrames[sampleCount] = it->first;
+        sampleStates[sampleCount++] = &it->second;
+        if(it == first) break;
+    }
+    double weights[5][4] = {};
+    for(int p=1; p<=sampleCount; ++p)
+    {
+        // The weight of each sample is the Lagrange basis polynomial through the first p samples, which reproduces the constant, linear, quadratic and cubic predictors
+        for(int k=0; k<p; ++k)
+        {
+            weights[p][k] = 1;
+            for(int m=0; m<p; ++m) if(m != k) weights[p][k] *= (frame - sampleFrames[m]) / (sampleFrames[k] - sampleFrames[m]);
+        }
+    }
+
+    // Each field is extrapolated with the curve predictor which has best predicted it so far, or the linear predictor for vector components
+    const auto & distribs = peer->remote.frames.rbegin()->second.distribs;
+    for(int i=0; i<count; ++i)
+    {
+        auto field = fields[i];
+        if(field->cl != cl) { values[i] = 0; continue; }
+        if(field->isConst || field->numValues) { values[i] = getValue(field, *sampleStates[0]); continue; }
+        int p = field->vec ? std::min(sampleCount, 2) : distribs.intFieldDists[field->uniqueId].GetBestDistribution(sampleCount);
+        if(p < 1 || p >= 5) p = 1; // The zero predictor and custom predictors cannot extrapolate
+        values[i] = 0;
+        for(int k=0; k<p; ++k) values[i] += weights[p][k] * field->GetValue(sampleStates[k]->data() + varStateOffset);
+    }
+}
 
+RemoteSet::~RemoteSet()
+{
+    // Views release their references to blobs when destroyed, so they must not outlive the blob table
+    destroyedViews.clear();
+    events.clear();
+    frames.clear();
 }
 
-RemoteSet::RemoteSet(const NCprotocol * protocol) : protocol(protocol)
+RemoteSet::RemoteSet(const NCprotocol * protocol) : protocol(protocol), latestState(), eventFrame(0)
 {
 
 }
 
+int RemoteSet::GetNewestFrame() const
+{
+    return frames.empty() ? 0 : frames.rbegin()->first;
+}
+
 int RemoteSet::GetObjectCount() const
 {
     if(frames.empty()) return 0;
-    return frames.rbegin()->second.views.size() + events.size();        
+    auto & frame = frames.rbegin()->second;
+    return frame.views.size() - frame.missingViews + events.size();        
 }
 
 const NCobject * RemoteSet::GetObjectFromIndex(int index) const
 { 
     if(frames.empty()) return nullptr;
     auto & frame = frames.rbegin()->second;
-    if(index < frame.views.size()) return frame.views[index].get();
-    return events[index - frame.views.size()].get();
+    if(frame.missingViews == 0)
+    {
+        if(index < frame.views.size()) return frame.views[index].get();
+        return events[index - frame.views.size()].get();
+    }
+    for(auto & view : frame.views) if(view && index-- == 0) return view.get(); // Skip views whose part of the message has not yet arrived
+    return events[index].get();
 }
 
 const NCobject * RemoteSet::GetObjectFromUniqueId(int uniqueId) const
@@ -95,94 +203,312 @@ int RemoteSet::GetUniqueIdFromObject(const NCobject * object) const
     if(frames.empty()) return 0;
     for(auto & view : frames.rbegin()->second.views)
     {
-        if(view.get() == object) return view->uniqueId;
+        if(view && view.get() == object) return view->uniqueId;
     }
     return 0;
 }
 
+template<class T, class F> int RemoteSet::GetValues(const NCclass * cl, T * values, F getValue) const
+{
+    // Views and events are visited in the same order as GetObjectFromIndex(...)
+    int count = 0;
+    if(!frames.empty()) for(auto & view : frames.rbegin()->second.views)
+    {
+        if(!view || view->cl != cl) continue;
+        if(values) values[count] = getValue(*view);
+        ++count;
+    }
+    for(auto & event : events)
+    {
+        if(event->cl != cl) continue;
+        if(values) values[count] = getValue(*event);
+        ++count;
+    }
+    return count;
+}
+
+int RemoteSet::GetObjects(const NCclass * cl, const NCobject ** objects) const
+{
+    return GetValues(cl, objects, [](const Object & view) { return &view; });
+}
+
+int RemoteSet::GetInts(const NCint * field, int * values) const
+{
+    if(field->isConst) return GetValues(field->cl, values, [field](const Object & view) { return field->GetValue(view.constState.data()); });
+    return GetValues(field->cl, values, [this, field](const Object & view) { return field->GetValue(latestState + view.varStateOffset); });
+}
+
+int RemoteSet::GetFloats(const NCfloat * field, float * values) const
+{
+    if(field->field.isConst) return GetValues(field->field.cl, values, [field](const Object & view) { return field->Dequantize(field->field.GetValue(view.constState.data())); });
+    return GetValues(field->field.cl, values, [this, field](const Object & view) { return field->Dequantize(field->field.GetValue(latestState + view.varStateOffset)); });
+}
+
+const NCobject * RemoteSet::GetCreatedObject(int index) const
+{
+    return index >= 0 && index < GetCreatedObjectCount() ? createdViews[index] : nullptr;
+}
+
+const NCobject * RemoteSet::GetDestroyedObject(int index) const
+{
+    return index >= 0 && index < GetDestroyedObjectCount() ? destroyedViews[index].get() : nullptr;
+}
+
+const NCobject * RemoteSet::GetChangedObject(int index) const
+{
+    return index >= 0 && index < GetChangedObjectCount() ? changedViews[index].first : nullptr;
+}
+
+bool RemoteSet::IsIntChanged(int index, const NCint * field) const
+{
+    if(index < 0 || index >= GetChangedObjectCount()) return false;
+    auto & change = changedViews[index];
+    if(field->cl != change.first->cl || field->isConst) return false;
+    return field->GetValue(changedStates.data() + change.second) != field->GetValue(latestState + change.first->varStateOffset);
+}
+
 void RemoteSet::ConsumeUpdate(ArithmeticDecoder & decoder, NCpeer * peer)
 {
-    const int mostRecentFrame = frames.empty() ? 0 : frames.rbegin()->first;
-    
+    // Changes are only reported for the most recently consumed message
+    for(auto view : createdViews) view->isCreated = false;
+    createdViews.clear();
+    destroyedViews.clear();
+    changedViews.clear();
+    changedStates.clear();
+
     // Decode frameset
-    const Frameset frameset(netcode::DecodeFramelist(decoder, 5, protocol->maxFrameDelta), frameStates);
-    if(!frames.empty() && frames.rbegin()->first >= frameset.GetCurrentFrame()) return; // Don't bother decoding messages for old frames
+    const auto frameList = netcode::DecodeFramelist(decoder, 5, protocol->maxFrameDelta, GetNewestFrame());
+    if(frameList.size() > 1 && frames.empty()) return; // Frame numbers relative to a previous frame cannot be resolved until we have received a keyframe
+    const Frameset frameset(*protocol, frameList, frameStates);
+    auto it = frames.find(frameset.GetCurrentFrame());
+    const bool isNewFrame = it == end(frames);
+    if(isNewFrame ? !frames.empty() && frames.rbegin()->first >= frameset.GetCurrentFrame() : it->second.IsComplete()) return; // Don't bother decoding messages for old frames, or parts of frames we already have
+    auto base = frames.find(frameset.GetPreviousFrame());
+    if(frameset.GetPreviousFrame() != 0 && (base == end(frames) || !base->second.IsComplete())) return; // Server referred to a frame we no longer have
     //for(int i=0; i<4; ++i) if(frameset.prevFrames[i] != 0 && frameset.prevStates[i] == nullptr) return; // Malformed packet
 
-    // Prepare probability distributions
-    auto & frame = frames[frameset.GetCurrentFrame()];
-    if(frameset.GetPreviousFrame() != 0) frame = frames[frameset.GetPreviousFrame()];
-    else frame.distribs = Distribs(*protocol);
+    // Prepare probability distributions, which each part of a message begins from independently
+    Distribs distribs = frameset.GetPreviousFrame() != 0 ? base->second.distribs : Distribs(*protocol);
 
-    // Decode events that occurred in each frame between the last acknowledged frame and the current frame
-    events.clear();
-    for(int i=frameset.GetPreviousFrame()+1; i<=frameset.GetCurrentFrame(); ++i)
+    // Decode which part of the message this is
+    size_t partCount = 1, partIndex = 0;
+    if(distribs.splitMessageDist.DecodeAndTally(decoder))
+    {
+        partCount = DecodeUniform(decoder, maxMessageParts-1) + 2;
+        partIndex = DecodeUniform(decoder, partCount);
+    }
+    if(!isNewFrame && (it->second.partCount != partCount || it->second.receivedParts.count(partIndex))) return; // Duplicate part
+
+    // Changes are reported for messages which update the newest frame. Views which may be absent from a new frame are hidden until they are placed on it, 
+    // and views which were visible before are compared against the previous newest frame, which is left untouched while a new frame is decoded.
+    const bool updatesNewest = isNewFrame || it == std::prev(end(frames));
+    const auto prevNewest = frames.empty() ? end(frames) : std::prev(end(frames));
+    const uint8_t * prevNewestState = isNewFrame && prevNewest != end(frames) ? frameStates.rbegin()->second.data() : nullptr;
+    std::vector<std::shared_ptr<Object>> hiddenViews;
+    auto hide = [&](const std::shared_ptr<Object> & view)
+    {
+        if(!view || !view->isVisible) return;
+        view->isVisible = false;
+        view->isHidden = true;
+        hiddenViews.push_back(view);
+    };
+    auto show = [&](const std::shared_ptr<Object> & view)
+    {
+        if(view->isVisible) return;
+        view->isVisible = true;
+        if(view->isHidden) return; // Views which were visible before this message are not created
+        view->lastState.clear();
+        view->lastBlobRefs = BlobRefs();
+        view->isCreated = true;
+        view->visibleFrame = frameset.GetCurrentFrame();
+        createdViews.push_back(view.get());
+        recentViews.push_back(view);
+    };
+    auto finishChanges = [&]()
+    {
+        // Hidden views which were not placed on the newest frame are destroyed, and kept alive until the next message along with their state on the previous newest frame
+        for(auto & view : hiddenViews)
+        {
+            view->isHidden = false;
+            if(view->isVisible) continue;
+            view->lastState.assign(prevNewestState + view->varStateOffset, prevNewestState + view->varStateOffset + view->cl->varSizeInBytes);
+            std::vector<int> handles;
+            for(auto field : view->cl->varBlobs) handles.push_back(reinterpret_cast<const int &>(view->lastState[field->dataOffset]));
+            view->lastBlobRefs = BlobRefs(blobs, move(handles));
+            destroyedViews.push_back(move(view));
+        }
+    };
+
+    // Decode events that occurred in each frame between the last acknowledged frame and the current frame, which are only sent in the first part
+    if(partIndex == 0)
     {
-        // All of the events decoded in here happen on frame i
-        for(int j=0, n = frame.distribs.eventCountDist.DecodeAndTally(decoder); j<n; ++j)
+        if(frameset.GetCurrentFrame() > eventFrame) events.clear();
+        for(int i=frameset.GetFirstEventFrame(protocol->maxFrameDelta); i<=frameset.GetCurrentFrame(); ++i)
         {
-            auto classIndex = frame.distribs.eventClassDist.DecodeAndTally(decoder);
-            auto cl = protocol->eventClasses[classIndex];
-            auto state = frame.distribs.DecodeAndTallyObjectConstants(decoder, *cl);
-            if(i > mostRecentFrame) // Only generate an event once (it will likely be sent multiple times before being acknowledged)
+            // All of the events decoded in here happen on frame i
+            for(int j=0, n = distribs.eventCountDist.DecodeAndTally(decoder); j<n; ++j)
             {
-                events.push_back(std::unique_ptr<Object>(new Object(peer, 0, cl, i, std::move(state))));
+                auto classIndex = distribs.eventClassDist.DecodeAndTally(decoder);
+                auto cl = protocol->eventClasses[classIndex];
+                auto state = distribs.DecodeAndTallyObjectConstants(decoder, *cl, blobs);
+                if(i > eventFrame) // Only generate an event once (it will likely be sent multiple times before being acknowledged)
+                {
+                    events.push_back(std::unique_ptr<Object>(new Object(peer, 0, cl, i, std::move(state))));
+                }
             }
         }
+        eventFrame = std::max(eventFrame, frameset.GetCurrentFrame());
     }
 
-    // Decode indices of deleted objects
-    int delObjects = frame.distribs.delObjectCountDist.DecodeAndTally(decoder);
-    for(int i=0; i<delObjects; ++i)
+    // Decode indices of deleted objects, which are sent in every part
+    const size_t numPrevViews = frameset.GetPreviousFrame() != 0 ? base->second.views.size() : 0;
+    const std::vector<int> deletedIndices = distribs.DecodeAndTallyDeletions(decoder, numPrevViews);
+	int newObjects = distribs.newObjectCountDist.DecodeAndTally(decoder);
+
+    // The first part to arrive determines the set of views on this frame, and the state of views in parts which have not yet arrived is retained from the previous frame
+    auto & frame = frames[frameset.GetCurrentFrame()];
+    auto & state = frameStates[frameset.GetCurrentFrame()];
+    if(isNewFrame)
     {
-        int index = DecodeUniform(decoder, frame.views.size());
-        frame.views[index].reset();
+        // Views which became visible after the base frame (or every view, for a keyframe) are only on this frame if they are sent again
+        if(frameset.GetPreviousFrame() == 0) { if(prevNewest != end(frames)) for(auto & view : prevNewest->second.views) hide(view); }
+        else for(auto & recent : recentViews)
+        {
+            auto view = recent.lock();
+            if(view && view->visibleFrame > frameset.GetPreviousFrame()) hide(view);
+        }
+
+        // Views on the base frame are retained unless they were deleted
+        if(frameset.GetPreviousFrame() != 0)
+        {
+            frame.views.reserve(base->second.views.size() - deletedIndices.size() + newObjects);
+            auto deleted = begin(deletedIndices);
+            for(size_t i=0; i<base->second.views.size(); ++i)
+            {
+                auto & view = base->second.views[i];
+                if(deleted != end(deletedIndices) && *deleted == static_cast<int>(i)) { ++deleted; hide(view); }
+                else { frame.views.push_back(view); show(view); }
+            }
+            state = frameStates[frameset.GetPreviousFrame()];
+        }
+        if(partCount > 1) frame.distribs = frameset.GetPreviousFrame() != 0 ? base->second.distribs : Distribs(*protocol);
+        frame.partCount = partCount;
+        frame.views.resize(frame.views.size() + newObjects);
+        frame.missingViews = newObjects;
     }
-    EraseIf(frame.views, [](const std::shared_ptr<Object> & v) { return !v; });
 
-	// Decode classes of newly created objects, and instantiate corresponding views
-	int newObjects = frame.distribs.newObjectCountDist.DecodeAndTally(decoder);
-	for (int i = 0; i < newObjects; ++i)
+	// Decode the range of views updated by this part, and the classes of newly created objects within that range, instantiating corresponding views
+    const size_t firstNewView = frame.views.size() - newObjects;
+    size_t first = 0, last = frame.views.size();
+    if(partCount > 1)
+    {
+        if(frame.views.empty()) { finishChanges(); return; } // Malformed packet
+        first = DecodeUniform(decoder, frame.views.size());
+        last = first + 1 + DecodeUniform(decoder, frame.views.size() - first);
+    }
+    std::vector<int> usedIds;
+    if(std::max(first, firstNewView) < last && frameset.GetPreviousFrame() != 0) for(auto & view : base->second.views) usedIds.push_back(view->uniqueId);
+    std::sort(begin(usedIds), end(usedIds));
+    int prevId = 0;
+	for(size_t i=std::max(first, firstNewView); i<last; ++i)
 	{
-        auto classIndex = frame.distribs.objectClassDist.DecodeAndTally(decoder);
-        auto uniqueId = frame.distribs.uniqueIdDist.DecodeAndTally(decoder);
-        auto state = frame.distribs.DecodeAndTallyObjectConstants(decoder, *protocol->objectClasses[classIndex]);
+        auto classIndex = distribs.objectClassDist.DecodeAndTally(decoder);
+        auto uniqueId = PredictUniqueId(usedIds, prevId) + distribs.newIdDist.DecodeAndTally(decoder);
+        prevId = uniqueId;
+        auto constState = distribs.DecodeAndTallyObjectConstants(decoder, *protocol->objectClasses[classIndex], blobs);
 
         auto it = id2View.find(uniqueId);
         auto ptr = it != end(id2View) ? it->second.lock() : nullptr;
         if(!ptr)
         {
-            ptr = std::make_shared<Object>(peer, uniqueId, protocol->objectClasses[classIndex], frameset.GetCurrentFrame(), move(state));
+            ptr = std::make_shared<Object>(peer, uniqueId, protocol->objectClasses[classIndex], frameset.GetCurrentFrame(), move(constState));
             id2View[uniqueId] = ptr;
         }
-        frame.views.push_back(ptr);
+        frame.views[i] = ptr;
+        --frame.missingViews;
+        if(updatesNewest) show(ptr);
 	}
-
-    auto & state = frameStates[frameset.GetCurrentFrame()];
     state.resize(std::max(stateAlloc.GetTotalCapacity(),size_t(1)));
 
-	// Decode updates for each view
-	for(auto view : frame.views)
+    // Views which were already visible have changed if their state differs from the state they had before this message
+    auto recordChange = [&](const Object & view, const uint8_t * before)
+    {
+        if(std::equal(before, before + view.cl->varSizeInBytes, state.data() + view.varStateOffset)) return;
+        changedViews.push_back({&view, changedStates.size()});
+        changedStates.insert(end(changedStates), before, before + view.cl->varSizeInBytes);
+    };
+    if(isNewFrame && partCount > 1 && prevNewestState)
     {
-        frameset.DecodeAndTallyObject(decoder, frame.distribs, *view->cl, view->varStateOffset, view->frameAdded, state.data());
+        // Views outside the range of the first part of a split frame retain their state from the base frame until their part arrives
+        for(size_t i=0; i<frame.views.size(); ++i)
+        {
+            auto & view = frame.views[i];
+            if((i < first || i >= last) && view && view->isVisible && !view->isCreated) recordChange(*view, prevNewestState + view->varStateOffset);
+        }
     }
 
+	// Decode updates for each view, retaining the previous state of any views whose updates were deferred
+    const bool isPartial = distribs.partialUpdateDist.DecodeAndTally(decoder) != 0;
+    std::vector<uint8_t> before;
+	for(size_t i=first; i<last; ++i)
+    {
+        auto & view = frame.views[i];
+        const bool wasVisible = updatesNewest && view->isVisible && !view->isCreated;
+        if(wasVisible && !prevNewestState) before.assign(state.data() + view->varStateOffset, state.data() + view->varStateOffset + view->cl->varSizeInBytes);
+        if(isPartial && frameset.GetSampleCount(view->frameAdded) > 0 && distribs.deferredObjectDist.DecodeAndTally(decoder))
+        {
+            auto prevState = frameset.GetPreviousState() + view->varStateOffset;
+            std::copy(prevState, prevState + view->cl->varSizeInBytes, state.data() + view->varStateOffset);
+        }
+        else frameset.DecodeAndTallyObject(decoder, distribs, *view->cl, view->varStateOffset, view->frameAdded, state.data(), blobs);
+        if(wasVisible) recordChange(*view, prevNewestState ? prevNewestState + view->varStateOffset : before.data());
+    }
+
+    // Once all parts have arrived, probability distributions at the end of this frame include the values tallied by every part
+    if(partCount == 1) frame.distribs = distribs;
+    else
+    {
+        frame.receivedParts[partIndex] = distribs;
+        if(frame.receivedParts.size() == partCount)
+        {
+            auto merged = frame.distribs;
+            for(auto & part : frame.receivedParts) merged.Accumulate(frame.distribs, part.second);
+            frame.distribs = merged;
+            frame.receivedParts.clear();
+        }
+    }
+
+    finishChanges();
+
+    // Blobs in the state of this frame, or in the dictionaries of its distributions, must not be evicted until it expires
+    std::vector<int> handles = frame.distribs.blobDictionary;
+    for(auto & part : frame.receivedParts) handles.insert(end(handles), begin(part.second.blobDictionary), end(part.second.blobDictionary));
+    for(auto & view : frame.views) if(view) for(auto field : view->cl->varBlobs) handles.push_back(reinterpret_cast<const int &>(state[view->varStateOffset + field->dataOffset]));
+    frameBlobRefs[frameset.GetCurrentFrame()] = BlobRefs(blobs, move(handles));
+
     // Server will never again refer to frames before this point
-    int lastFrameToKeep = std::min(frameset.GetCurrentFrame() - protocol->maxFrameDelta, frameset.GetEarliestFrame());
+    int lastFrameToKeep = frameset.GetCurrentFrame() - protocol->maxFrameDelta;
     EraseBefore(frames, lastFrameToKeep);
     EraseBefore(frameStates, lastFrameToKeep);
+    EraseBefore(frameBlobRefs, lastFrameToKeep);
+    EraseIf(recentViews, [lastFrameToKeep](const std::weak_ptr<Object> & recent) { auto view = recent.lock(); return !view || !view->isVisible || view->visibleFrame <= lastFrameToKeep; });
+    latestState = frameStates.rbegin()->second.data();
     for(auto it = id2View.begin(); it != end(id2View); )
     {
         if(it->second.expired()) it = id2View.erase(it);
         else ++it;
     }
+    blobs.Collect();
 }
 
 void RemoteSet::ProduceResponse(ArithmeticEncoder & encoder) const
 {
-    auto n = std::min(frames.size(), size_t(4));
-    int ackFrames[4];
-    auto it = frames.rbegin();
-    for(size_t i=0; i<n; ++i, ++it) ackFrames[i] = it->first;
-    netcode::EncodeFramelist(encoder, ackFrames, n, 4, protocol->maxFrameDelta);
+    // Acknowledge the newest frame for which every part of the message has arrived, along with all such frames within the ack window preceding it
+    std::vector<int> ackFrames;
+    for(auto it = frames.rbegin(); it != frames.rend(); ++it)
+    {
+        if(!ackFrames.empty() && it->first < ackFrames[0] - protocol->ackWindow) break;
+        if(it->second.IsComplete()) ackFrames.push_back(it->first);
+    }
+    netcode::EncodeAcks(encoder, ackFrames, protocol->ackWindow);
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include "utility.h"
 
 #include <cassert>
+#include <climits>
 
 namespace netcode
 {
@@ -26,7 +27,7 @@ namespace netcode
     // ArithmeticEncoder //
     ///////////////////////
 
-    ArithmeticEncoder::ArithmeticEncoder(std::vector<uint8_t> & buffer) : buffer(buffer), bitIndex(7), underflow(), min(BOUND0), max(BOUND4)
+    ArithmeticEncoder::ArithmeticEncoder(std::vector<uint8_t> & buffer) : buffer(buffer), bitIndex(7), underflow(), min(BOUND0), max(BOUND4), tape()
     {
 
     }
@@ -51,6 +52,7 @@ namespace netcode
     void ArithmeticEncoder::Encode(code_t a, code_t b, code_t denom)
     {
 	    assert(0 <= a && a < b && b <= denom && denom <= MAX_DENOM);
+	    if(tape) tape->insert(end(*tape), {a, b, denom});
 	    const code_t step = (max - min) / denom;
 	    max = min + step * b;
 	    min = min + step * a;
@@ -79,6 +81,16 @@ namespace netcode
 	    }
     }
 
+    void ArithmeticEncoder::Record(std::vector<code_t> * tape)
+    {
+        this->tape = tape;
+    }
+
+    void ArithmeticEncoder::Replay(const std::vector<code_t> & tape)
+    {
+        for(size_t i=0; i+2<tape.size(); i+=3) Encode(tape[i], tape[i+1], tape[i+2]);
+    }
+
     void ArithmeticEncoder::Finish()
     {
 	    Write(1);
@@ -229,6 +241,12 @@ namespace netcode
         ++counts[symbol];
     }
 
+    void SymbolDistribution::Accumulate(const SymbolDistribution & base, const SymbolDistribution & part)
+    {
+        assert(base.counts.size() == counts.size() && part.counts.size() == counts.size());
+        for(size_t i=0; i<counts.size(); ++i) counts[i] += part.counts[i] - base.counts[i];
+    }
+
     void SymbolDistribution::EncodeAndTally(ArithmeticEncoder & encoder, size_t symbol)
     {
         assert(symbol < counts.size());
@@ -319,6 +337,13 @@ namespace netcode
         return cost;
     }
 
+    float IntegerDistribution::GetCost(int value) const
+    {
+        int bits = CountSignificantBits(value);
+        int bucket = bits + (value < 0 ? 32 : 0);
+        return -log2(dist.GetProbability(bucket)) + std::max(bits-1,0);
+    }
+
     void IntegerDistribution::Tally(int value)
     {
         int bits = CountSignificantBits(value)+1;
@@ -343,11 +368,160 @@ namespace netcode
         return bucket & 0x20 ? ~value : value; // restore sign if this number belonged to a negative bucket
     }
 
+    static int CountSignificantBits64(int64_t value)
+    {
+        int64_t sign = value < 0 ? -1 : 0;
+        for (int i = 0; i < 63; ++i) if (value >> i == sign) return i;
+        return 63;
+    }
+
+    Int64Distribution::Int64Distribution() : dist(64), largeDist(33)
+    {
+
+    }
+
+    float Int64Distribution::GetExpectedCost() const
+    {
+        float cost = 0;
+        for(int bits=0; bits<31; ++bits)
+        {
+            for(int bucket : {bits, bits + 32}) cost += dist.GetTrueProbability(bucket) * (-log(dist.GetProbability(bucket)) + std::max(bits-1,0));
+        }
+        float largeCost = 0;
+        for(int bits=31; bits<64; ++bits) largeCost += largeDist.GetProbability(bits-31) * (-log(largeDist.GetProbability(bits-31)) + bits-1);
+        for(int bucket : {31, 63}) cost += dist.GetTrueProbability(bucket) * (-log(dist.GetProbability(bucket)) + largeCost);
+        return cost;
+    }
+
+    float Int64Distribution::GetCost(int64_t value) const
+    {
+        int bits = CountSignificantBits64(value);
+        int bucket = std::min(bits, 31) + (value < 0 ? 32 : 0);
+        float cost = -log2(dist.GetProbability(bucket)) + std::max(bits-1,0);
+        return bits < 31 ? cost : cost - log2(largeDist.GetProbability(bits-31));
+    }
+
+    void Int64Distribution::Tally(int64_t value)
+    {
+        int bits = CountSignificantBits64(value);
+        dist.Tally(std::min(bits, 31) + (value < 0 ? 32 : 0));
+        if(bits >= 31) largeDist.Tally(bits-31);
+    }
+
+    void Int64Distribution::EncodeAndTally(ArithmeticEncoder & encoder, int64_t value)
+    {
+        int bits = CountSignificantBits64(value);
+        dist.EncodeAndTally(encoder, std::min(bits, 31) + (value < 0 ? 32 : 0));
+        if(bits >= 31) largeDist.EncodeAndTally(encoder, bits-31);
+        if(value < 0) value = ~value;
+        if(bits > 32) // encode the bits below the most significant bit, 32 at a time
+        {
+            EncodeBits(encoder, static_cast<code_t>(value), 32);
+            EncodeBits(encoder, static_cast<code_t>(value >> 32), bits-33);
+        }
+        else if(bits > 0) EncodeBits(encoder, static_cast<code_t>(value), bits-1);
+    }
+
+    int64_t Int64Distribution::DecodeAndTally(ArithmeticDecoder & decoder)
+    {
+        int bucket = dist.DecodeAndTally(decoder);
+        int bits = bucket & 0x1F;
+        if(bits == 31) bits += largeDist.DecodeAndTally(decoder);
+        int64_t value = 0;
+        if(bits > 32)
+        {
+            value = DecodeBits(decoder, 32);
+            value |= int64_t(DecodeBits(decoder, bits-33)) << 32;
+        }
+        else if(bits > 0) value = DecodeBits(decoder, bits-1);
+        if(bits > 0) value |= int64_t(1) << (bits-1);
+        return bucket & 0x20 ? ~value : value;
+    }
+
+    //////////////////////
+    // EnumDistribution //
+    //////////////////////
+
+    EnumDistribution::EnumDistribution(size_t numValues) : initialDist(numValues), changeDists(numValues, SymbolDistribution(2)), changedValueDist(std::max(numValues, size_t(2)) - 1)
+    {
+
+    }
+
+    float EnumDistribution::GetCost(int value, int prevValue) const
+    {
+        if(prevValue < 0) return -log2(initialDist.GetProbability(value));
+        float cost = -log2(changeDists[prevValue].GetProbability(value != prevValue));
+        if(value != prevValue) cost -= log2(changedValueDist.GetProbability(value < prevValue ? value : value - 1));
+        return cost;
+    }
+
+    void EnumDistribution::Accumulate(const EnumDistribution & base, const EnumDistribution & part)
+    {
+        initialDist.Accumulate(base.initialDist, part.initialDist);
+        for(size_t i=0; i<changeDists.size(); ++i) changeDists[i].Accumulate(base.changeDists[i], part.changeDists[i]);
+        changedValueDist.Accumulate(base.changedValueDist, part.changedValueDist);
+    }
+
+    void EnumDistribution::EncodeAndTally(ArithmeticEncoder & encoder, int value, int prevValue)
+    {
+        if(prevValue < 0) return initialDist.EncodeAndTally(encoder, value);
+        changeDists[prevValue].EncodeAndTally(encoder, value != prevValue);
+        if(value != prevValue) changedValueDist.EncodeAndTally(encoder, value < prevValue ? value : value - 1);
+    }
+
+    int EnumDistribution::DecodeAndTally(ArithmeticDecoder & decoder, int prevValue)
+    {
+        if(prevValue < 0) return initialDist.DecodeAndTally(decoder);
+        if(!changeDists[prevValue].DecodeAndTally(decoder)) return prevValue;
+        int value = changedValueDist.DecodeAndTally(decoder);
+        return value < prevValue ? value : value + 1;
+    }
+
+    ///////////////////////
+    // ArrayDistribution //
+    ///////////////////////
+
+    float ArrayDistribution::GetCost(const int * values, int length, const int * prevValues, int prevLength) const
+    {
+        float cost = lengthDist.GetCost(length - std::max(prevLength, 0));
+        for(int i=0; i<length; ++i) cost += i < prevLength ? matchedDist.GetCost(values[i] - prevValues[i]) : appendedDist.GetCost(values[i] - (i ? values[i-1] : 0));
+        return cost;
+    }
+
+    void ArrayDistribution::Accumulate(const ArrayDistribution & base, const ArrayDistribution & part)
+    {
+        lengthDist.Accumulate(base.lengthDist, part.lengthDist);
+        matchedDist.Accumulate(base.matchedDist, part.matchedDist);
+        appendedDist.Accumulate(base.appendedDist, part.appendedDist);
+    }
+
+    void ArrayDistribution::EncodeAndTally(ArithmeticEncoder & encoder, const int * values, int length, const int * prevValues, int prevLength)
+    {
+        lengthDist.EncodeAndTally(encoder, length - std::max(prevLength, 0));
+        for(int i=0; i<length; ++i)
+        {
+            if(i < prevLength) matchedDist.EncodeAndTally(encoder, values[i] - prevValues[i]);
+            else appendedDist.EncodeAndTally(encoder, values[i] - (i ? values[i-1] : 0));
+        }
+    }
+
+    int ArrayDistribution::DecodeAndTally(ArithmeticDecoder & decoder, int * values, int capacity, const int * prevValues, int prevLength)
+    {
+        int length = std::max(std::min(lengthDist.DecodeAndTally(decoder) + std::max(prevLength, 0), capacity), 0);
+        for(int i=0; i<length; ++i)
+        {
+            if(i < prevLength) values[i] = prevValues[i] + matchedDist.DecodeAndTally(decoder);
+            else values[i] = (i ? values[i-1] : 0) + appendedDist.DecodeAndTally(decoder);
+        }
+        std::fill(values + length, values + capacity, 0);
+        return length;
+    }
+
     ////////////////////
     // CurvePredictor //
     ////////////////////
 
-    CurvePredictor::CurvePredictor(const int (&m)[4][4]) :
+    CurvePredictor::CurvePredictor(const int64_t (&m)[4][4]) :
         c0(m[1][1]*m[2][2]*m[3][3] + m[3][1]*m[1][2]*m[2][3] + m[2][1]*m[3][2]*m[1][3] - m[1][1]*m[3][2]*m[2][3] - m[2][1]*m[1][2]*m[3][3] - m[3][1]*m[2][2]*m[1][3]),
         c1(m[0][1]*m[3][2]*m[2][3] + m[2][1]*m[0][2]*m[3][3] + m[3][1]*m[2][2]*m[0][3] - m[3][1]*m[0][2]*m[2][3] - m[2][1]*m[3][2]*m[0][3] - m[0][1]*m[2][2]*m[3][3]),
         c2(m[0][1]*m[1][2]*m[3][3] + m[3][1]*m[0][2]*m[1][3] + m[1][1]*m[3][2]*m[0][3] - m[0][1]*m[3][2]*m[1][3] - m[1][1]*m[0][2]*m[3][3] - m[3][1]*m[1][2]*m[0][3]),
@@ -357,7 +531,40 @@ namespace netcode
             + m[0][2]*(m[1][3]*m[2][0]*m[3][1] + m[3][3]*m[1][0]*m[2][1] + m[2][3]*m[3][0]*m[1][1] - m[1][3]*m[3][0]*m[2][1] - m[2][3]*m[1][0]*m[3][1] - m[3][3]*m[2][0]*m[1][1])
             + m[0][3]*(m[1][0]*m[3][1]*m[2][2] + m[2][0]*m[1][1]*m[3][2] + m[3][0]*m[2][1]*m[1][2] - m[1][0]*m[2][1]*m[3][2] - m[3][0]*m[1][1]*m[2][2] - m[2][0]*m[3][1]*m[1][2]))
     {
+        // Reducing to lowest terms does not change any prediction, but keeps the coefficients small enough to evaluate safely
+        auto gcd = [](int64_t a, int64_t b) { while(b) { auto r = a % b; a = b; b = r; } return a < 0 ? -a : a; };
+        auto divisor = gcd(gcd(gcd(c0, c1), gcd(c2, c3)), denom);
+        if(denom < 0) divisor = -divisor;
+        if(divisor == 0) return;
+        c0 /= divisor;
+        c1 /= divisor;
+        c2 /= divisor;
+        c3 /= divisor;
+        denom /= divisor;
+    }
 
+    bool CurvePredictor::IsSafe() const
+    {
+        const int64_t limit = INT64_MAX >> 31; // Samples may be as large as 2^31 in magnitude
+        auto magnitude = [](int64_t c) { return c < 0 ? -c : c; };
+        return denom != 0 && magnitude(c0) + magnitude(c1) + magnitude(c2) + magnitude(c3) <= limit;
+    }
+
+    int64_t CurvePredictor::operator()(const int64_t (&samples)[4]) const
+    {
+        // Every predictor but the zero predictor reproduces a constant sequence exactly, so its coefficients sum to the denominator and
+        // it can be evaluated on the differences from the first sample, which stay small even when the values themselves are huge
+        if(!c0 && !c1 && !c2 && !c3) return 0;
+        const int64_t coeffs[4] = {c0, c1, c2, c3};
+        int64_t sum = 0;
+        for(int i=1; i<4; ++i)
+        {
+            if(!coeffs[i]) continue;
+            auto delta = static_cast<int64_t>(static_cast<uint64_t>(samples[i]) - static_cast<uint64_t>(samples[0]));
+            if(delta < INT_MIN || delta > INT_MAX) return samples[0];
+            sum += coeffs[i] * delta;
+        }
+        return static_cast<int64_t>(static_cast<uint64_t>(samples[0]) + static_cast<uint64_t>(sum / denom));
     }
 
     CurvePredictor MakeZeroPredictor() 
@@ -367,7 +574,7 @@ namespace netcode
 
     CurvePredictor MakeConstantPredictor()
     {
-        const int matrix[4][4] = {
+        const int64_t matrix[4][4] = {
             {1,0,0,0},
             {0,1,0,0},
             {0,0,1,0},
@@ -378,7 +585,7 @@ namespace netcode
 
     CurvePredictor MakeLinearPredictor(int t0, int t1)
     {
-        const int matrix[4][4] = {
+        const int64_t matrix[4][4] = {
             {1,t0,0,0},
             {1,t1,0,0},
             {0,0,1,0},
@@ -389,10 +596,10 @@ namespace netcode
 
     CurvePredictor MakeQuadraticPredictor(int t0, int t1, int t2)
     {
-        const int matrix[4][4] = {
-            {1,t0,t0*t0,0},
-            {1,t1,t1*t1,0},
-            {1,t2,t2*t2,0},
+        const int64_t matrix[4][4] = {
+            {1,t0,int64_t(t0)*t0,0},
+            {1,t1,int64_t(t1)*t1,0},
+            {1,t2,int64_t(t2)*t2,0},
             {0,0,0,1}
         };
         return CurvePredictor(matrix);
@@ -400,15 +607,35 @@ namespace netcode
 
     CurvePredictor MakeCubicPredictor(int t0, int t1, int t2, int t3)
     {
-        const int matrix[4][4] = {
-            {1,t0,t0*t0,t0*t0*t0},
-            {1,t1,t1*t1,t1*t1*t1},
-            {1,t2,t2*t2,t2*t2*t2},
-            {1,t3,t3*t3,t3*t3*t3}
+        const int64_t matrix[4][4] = {
+            {1,t0,int64_t(t0)*t0,int64_t(t0)*t0*t0},
+            {1,t1,int64_t(t1)*t1,int64_t(t1)*t1*t1},
+            {1,t2,int64_t(t2)*t2,int64_t(t2)*t2*t2},
+            {1,t3,int64_t(t3)*t3,int64_t(t3)*t3*t3}
         };
         return CurvePredictor(matrix);
     }
 
+    void PredictorCache::GetPredictors(const int (&frameDeltas)[4], CurvePredictor (&predictors)[5])
+    {
+        const std::array<int,4> key = {{frameDeltas[0], frameDeltas[1], frameDeltas[2], frameDeltas[3]}};
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = this->predictors.find(key);
+        if(it == end(this->predictors))
+        {
+            // Higher order predictors which could overflow are replaced with the constant predictor, as are those which lack samples
+            auto & p = this->predictors[key];
+            p[0] = CurvePredictor();
+            p[1] = frameDeltas[0] ? MakeConstantPredictor() : p[0];
+            p[2] = frameDeltas[1] ? MakeLinearPredictor(frameDeltas[0], frameDeltas[1]) : p[1];
+            p[3] = frameDeltas[2] ? MakeQuadraticPredictor(frameDeltas[0], frameDeltas[1], frameDeltas[2]) : p[1];
+            p[4] = frameDeltas[3] ? MakeCubicPredictor(frameDeltas[0], frameDeltas[1], frameDeltas[2], frameDeltas[3]) : p[1];
+            for(auto & predictor : p) if(!predictor.IsSafe()) predictor = p[1];
+            it = this->predictors.find(key);
+        }
+        std::copy(begin(it->second), end(it->second), predictors);
+    }
+
     ///////////////////////
     // FieldDistribution //
     ///////////////////////
@@ -417,7 +644,85 @@ namespace netcode
     {
         int bestDist = 0;
         float bestCost = dists[0].GetExpectedCost();
-        for(int i=1; i<=sampleCount; ++i)
+        for(int i=1, n=dists.size(); i<n; ++i)
+        {
+            if(i > sampleCount && i < 5) continue; // Curve predictors require enough samples
+            float cost = dists[i].GetExpectedCost();
+            if(cost < bestCost)
+            {
+                bestDist = i;
+                bestCost = cost;
+            }
+        }
+        return bestDist;
+    }
+
+    int FieldDistribution::SelectDistribution(int sampleCount) const
+    {
+        return lockedDist >= 0 && (lockedDist <= sampleCount || lockedDist >= 5) ? lockedDist : GetBestDistribution(sampleCount);
+    }
+
+    void FieldDistribution::TallyOthers(int value, const int * predictions, int sampleCount, int selected)
+    {
+        if(selected == lockedDist) return;
+        for(int i=0, n=dists.size(); i<n; i = i == sampleCount ? 5 : i+1) if(i != selected) dists[i].Tally(value - predictions[i]);
+
+        // Lock in the best predictor once it has remained the best for enough consecutive values, comparing only when every predictor is available
+        if(warmup == 0 || sampleCount < 4 || lockedDist >= 0) return;
+        if(selected != candidateDist)
+        {
+            candidateDist = selected;
+            stableCount = 0;
+        }
+        if(++stableCount >= warmup) lockedDist = candidateDist;
+    }
+
+    void FieldDistribution::Accumulate(const FieldDistribution & base, const FieldDistribution & part)
+    {
+        for(size_t i=0; i<dists.size(); ++i) dists[i].Accumulate(base.dists[i], part.dists[i]);
+
+        // Adopt the warmup state of any part which changed it, which gives the same result whether parts are accumulated onto the base or onto the first part
+        if(lockedDist < 0 && (part.candidateDist != base.candidateDist || part.stableCount != base.stableCount || part.lockedDist != base.lockedDist))
+        {
+            candidateDist = part.candidateDist;
+            stableCount = part.stableCount;
+            lockedDist = part.lockedDist;
+        }
+    }
+
+    float FieldDistribution::GetCost(int value, const int * predictions, int sampleCount) const
+    {
+        int selected = SelectDistribution(sampleCount);
+        return dists[selected].GetCost(value - predictions[selected]);
+    }
+
+    void FieldDistribution::EncodeAndTally(ArithmeticEncoder & encoder, int value, const int * predictions, int sampleCount)
+    {
+        int selected = SelectDistribution(sampleCount);
+        dists[selected].EncodeAndTally(encoder, value - predictions[selected]);
+        TallyOthers(value, predictions, sampleCount, selected);
+    }
+
+    int FieldDistribution::DecodeAndTally(ArithmeticDecoder & decoder, const int * predictions, int sampleCount)
+    {
+        int selected = SelectDistribution(sampleCount);
+        int value = dists[selected].DecodeAndTally(decoder) + predictions[selected];
+        TallyOthers(value, predictions, sampleCount, selected);
+        return value;
+    }
+
+    ////////////////////////////
+    // Int64FieldDistribution //
+    ////////////////////////////
+
+    static int64_t GetResidual(int64_t value, int64_t prediction) { return static_cast<int64_t>(static_cast<uint64_t>(value) - static_cast<uint64_t>(prediction)); }
+    static int64_t ApplyResidual(int64_t residual, int64_t prediction) { return static_cast<int64_t>(static_cast<uint64_t>(prediction) + static_cast<uint64_t>(residual)); }
+
+    int Int64FieldDistribution::GetBestDistribution(int sampleCount) const
+    {
+        int bestDist = 0;
+        float bestCost = dists[0].GetExpectedCost();
+        for(int i=1; i<=sampleCount && i<5; ++i)
         {
             float cost = dists[i].GetExpectedCost();
             if(cost < bestCost)
@@ -429,21 +734,140 @@ namespace netcode
         return bestDist;
     }
 
-    void FieldDistribution::EncodeAndTally(ArithmeticEncoder & encoder, int value, const int (&prevValues)[4], const CurvePredictor (&predictors)[5], int sampleCount)
+    float Int64FieldDistribution::GetCost(int64_t value, const int64_t * predictions, int sampleCount) const
     {
-        int best = GetBestDistribution(sampleCount);
-        dists[best].EncodeAndTally(encoder, value - predictors[best](prevValues));
-        for(int i=0; i<=sampleCount; ++i) if(i != best) dists[i].Tally(value - predictors[i](prevValues));
+        int selected = GetBestDistribution(sampleCount);
+        return dists[selected].GetCost(GetResidual(value, predictions[selected]));
     }
 
-    int FieldDistribution::DecodeAndTally(ArithmeticDecoder & decoder, const int (&prevValues)[4], const CurvePredictor (&predictors)[5], int sampleCount)
+    void Int64FieldDistribution::Accumulate(const Int64FieldDistribution & base, const Int64FieldDistribution & part)
     {
-        int best = GetBestDistribution(sampleCount);
-        int value = dists[best].DecodeAndTally(decoder) + predictors[best](prevValues);
-        for(int i=0; i<=sampleCount; ++i) if(i != best) dists[i].Tally(value - predictors[i](prevValues));
+        for(size_t i=0; i<dists.size(); ++i) dists[i].Accumulate(base.dists[i], part.dists[i]);
+    }
+
+    void Int64FieldDistribution::EncodeAndTally(ArithmeticEncoder & encoder, int64_t value, const int64_t * predictions, int sampleCount)
+    {
+        int selected = GetBestDistribution(sampleCount);
+        dists[selected].EncodeAndTally(encoder, GetResidual(value, predictions[selected]));
+        for(int i=0; i<=sampleCount && i<5; ++i) if(i != selected) dists[i].Tally(GetResidual(value, predictions[i]));
+    }
+
+    int64_t Int64FieldDistribution::DecodeAndTally(ArithmeticDecoder & decoder, const int64_t * predictions, int sampleCount)
+    {
+        int selected = GetBestDistribution(sampleCount);
+        int64_t value = ApplyResidual(dists[selected].DecodeAndTally(decoder), predictions[selected]);
+        for(int i=0; i<=sampleCount && i<5; ++i) if(i != selected) dists[i].Tally(GetResidual(value, predictions[i]));
         return value;
     }
 
+    /////////////////////
+    // VecDistribution //
+    /////////////////////
+
+    VecDistribution::VecDistribution(int components) : models(5, Model{SymbolDistribution(32), std::vector<SymbolDistribution>(components*8, SymbolDistribution(16)), 0, 0})
+    {
+
+    }
+
+    int VecDistribution::SelectModel(int sampleCount) const
+    {
+        int best = 0;
+        for(int i=1; i<=sampleCount; ++i)
+        {
+            if(models[i].count == 0) continue;
+            if(models[best].count == 0 || models[i].totalBits * models[best].count < models[best].totalBits * models[i].count) best = i;
+        }
+        return best;
+    }
+
+    static int GetComponentSymbol(int residual, int length) { return std::min(length - CountSignificantBits(residual), 7) + (residual < 0 ? 8 : 0); }
+
+    int VecDistribution::Model::GetLength(const int * values, int components, const int * predictions)
+    {
+        int length = 0;
+        for(int k=0; k<components; ++k) length = std::max(length, CountSignificantBits(values[k] - predictions[k]));
+        return length;
+    }
+
+    void VecDistribution::Model::TallyTotals(const int * values, int components, const int * predictions)
+    {
+        for(int k=0; k<components; ++k) totalBits += CountSignificantBits(values[k] - predictions[k]);
+        ++count;
+    }
+
+    void VecDistribution::Model::Tally(const int * values, int components, const int * predictions)
+    {
+        int length = GetLength(values, components, predictions);
+        lengthDist.Tally(length);
+        for(int k=0; k<components; ++k) componentDists[k*8 + std::min(length, 7)].Tally(GetComponentSymbol(values[k] - predictions[k], length));
+        TallyTotals(values, components, predictions);
+    }
+
+    float VecDistribution::GetCost(const int * values, int components, const int * predictions, size_t stride, int sampleCount) const
+    {
+        const int selected = SelectModel(sampleCount);
+        auto & model = models[selected];
+        const int * p = predictions + selected*stride;
+        int length = Model::GetLength(values, components, p);
+        float cost = -log2(model.lengthDist.GetProbability(length));
+        for(int k=0; k<components; ++k)
+        {
+            int residual = values[k] - p[k], bits = CountSignificantBits(residual);
+            cost += -log2(model.componentDists[k*8 + std::min(length, 7)].GetProbability(GetComponentSymbol(residual, length))) + std::max(bits-1, 0);
+            if(length - bits >= 7) cost += log2(length - 6);
+        }
+        return cost;
+    }
+
+    void VecDistribution::Accumulate(const VecDistribution & base, const VecDistribution & part)
+    {
+        for(size_t i=0; i<models.size(); ++i)
+        {
+            models[i].lengthDist.Accumulate(base.models[i].lengthDist, part.models[i].lengthDist);
+            for(size_t k=0; k<models[i].componentDists.size(); ++k) models[i].componentDists[k].Accumulate(base.models[i].componentDists[k], part.models[i].componentDists[k]);
+            models[i].totalBits += part.models[i].totalBits - base.models[i].totalBits;
+            models[i].count += part.models[i].count - base.models[i].count;
+        }
+    }
+
+    void VecDistribution::EncodeAndTally(ArithmeticEncoder & encoder, const int * values, int components, const int * predictions, size_t stride, int sampleCount)
+    {
+        // Only the residuals of the selected predictor are written, but every available predictor is tallied so that they may be compared
+        const int selected = SelectModel(sampleCount);
+        for(int i=0; i<=sampleCount; ++i) if(i != selected) models[i].Tally(values, components, predictions + i*stride);
+
+        auto & model = models[selected];
+        const int * p = predictions + selected*stride;
+        int length = Model::GetLength(values, components, p);
+        model.lengthDist.EncodeAndTally(encoder, length);
+        for(int k=0; k<components; ++k)
+        {
+            int residual = values[k] - p[k], bits = CountSignificantBits(residual);
+            model.componentDists[k*8 + std::min(length, 7)].EncodeAndTally(encoder, GetComponentSymbol(residual, length));
+            if(length - bits >= 7) EncodeUniform(encoder, bits, length - 6);
+            if(residual < 0) residual = ~residual;
+            if(bits > 0) EncodeBits(encoder, residual, bits-1); // encode the bits below the most significant bit
+        }
+        model.TallyTotals(values, components, p);
+    }
+
+    void VecDistribution::DecodeAndTally(ArithmeticDecoder & decoder, int * values, int components, const int * predictions, size_t stride, int sampleCount)
+    {
+        const int selected = SelectModel(sampleCount);
+        auto & model = models[selected];
+        const int * p = predictions + selected*stride;
+        int length = model.lengthDist.DecodeAndTally(decoder);
+        for(int k=0; k<components; ++k)
+        {
+            int symbol = model.componentDists[k*8 + std::min(length, 7)].DecodeAndTally(decoder);
+            int bits = (symbol & 7) == 7 ? DecodeUniform(decoder, length - 6) : length - (symbol & 7);
+            int residual = bits > 0 ? DecodeBits(decoder, bits-1) | (1 << (bits-1)) : 0; // decode the bits below the most significant bit
+            values[k] = p[k] + (symbol & 8 ? ~residual : residual);
+        }
+        model.TallyTotals(values, components, p);
+        for(int i=0; i<=sampleCount; ++i) if(i != selected) models[i].Tally(values, components, predictions + i*stride);
+    }
+
     ////////////////////
     // RangeAllocator //
     ////////////////////
@@ -476,4 +900,161 @@ namespace netcode
     {
         if(amount != 0) freeList.push_back({offset,amount});
     }
-}
\ No newline at end of file
+
+    ///////////////
+    // BlobTable //
+    ///////////////
+
+    BlobTable::BlobTable()
+    {
+        Intern(nullptr, 0);
+    }
+
+    size_t BlobTable::GetBlobCount() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return handles.size();
+    }
+
+    const std::vector<uint8_t> & BlobTable::Get(int handle) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return handle >= 0 && size_t(handle) < blobs.size() ? blobs[handle] : blobs[0];
+    }
+
+    int BlobTable::Intern(const uint8_t * data, size_t size)
+    {
+        std::vector<uint8_t> blob(data, data + size);
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = handles.find(blob);
+        if(it != end(handles)) return it->second;
+
+        // New blobs have no references until they are stored somewhere, so they are evicted by the next collection unless one is taken
+        int handle = blobs.size();
+        if(!freeHandles.empty())
+        {
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+            blobs[handle] = std::move(blob);
+        }
+        else
+        {
+            blobs.push_back(std::move(blob));
+            refCounts.push_back(0);
+        }
+        handles[blobs[handle]] = handle;
+        unreferenced.push_back(handle);
+        return handle;
+    }
+
+    void BlobTable::AddRefs(const int * handles, size_t count) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(size_t i=0; i<count; ++i) if(handles[i] > 0 && size_t(handles[i]) < refCounts.size()) ++refCounts[handles[i]];
+    }
+
+    void BlobTable::ReleaseRefs(const int * handles, size_t count) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(size_t i=0; i<count; ++i) if(handles[i] > 0 && size_t(handles[i]) < refCounts.size() && --refCounts[handles[i]] == 0) unreferenced.push_back(handles[i]);
+    }
+
+    void BlobTable::Collect()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(auto handle : unreferenced)
+        {
+            if(handle == 0 || refCounts[handle] != 0) continue;
+            auto it = handles.find(blobs[handle]);
+            if(it == end(handles) || it->second != handle) continue; // Already evicted, as it was released more than once since the last collection
+            handles.erase(it);
+            blobs[handle] = {};
+            freeHandles.push_back(handle);
+        }
+        unreferenced.clear();
+    }
+
+    ////////////////
+    // ThreadPool //
+    ////////////////
+
+    ThreadPool::ThreadPool(size_t threadCount) : pendingTasks(0), nextQueue(0), isStopping(false)
+    {
+        for(size_t i=0; i<std::max(threadCount, size_t(1)); ++i) queues.emplace_back(new Queue);
+        for(size_t i=0; i<threadCount; ++i) threads.emplace_back([this, i]()
+        {
+            while(true)
+            {
+                if(RunTask(i)) continue;
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return isStopping || pendingTasks > 0; });
+                if(isStopping) return;
+            }
+        });
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isStopping = true;
+        }
+        wake.notify_all();
+        for(auto & thread : threads) thread.join();
+    }
+
+    bool ThreadPool::RunTask(size_t queue)
+    {
+        // Workers take the most recently submitted task from their own queue, and steal the least recently submitted task from other queues
+        std::function<void()> task;
+        for(size_t i=0; i<queues.size() && !task; ++i)
+        {
+            auto & q = *queues[(queue + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if(q.tasks.empty()) continue;
+            if(i == 0) { task = move(q.tasks.back()); q.tasks.pop_back(); }
+            else { task = move(q.tasks.front()); q.tasks.pop_front(); }
+        }
+        if(!task) return false;
+        --pendingTasks;
+        task();
+
+        // Threads helping the pool may be waiting for this task to finish
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.notify_all();
+        return true;
+    }
+
+    void ThreadPool::Submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++pendingTasks;
+        }
+        auto & q = *queues[nextQueue++ % queues.size()];
+        {
+            std::lock_guard<std::mutex> lock(q.mutex);
+            q.tasks.push_back(move(task));
+        }
+        wake.notify_one();
+    }
+
+    void ThreadPool::Help(const std::function<bool()> & isDone)
+    {
+        // Once no tasks remain to be taken, wait for those being run by worker threads to finish, rather than spinning
+        size_t queue = nextQueue++ % queues.size();
+        while(!isDone())
+        {
+            if(RunTask(queue)) continue;
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&]() { return pendingTasks > 0 || isDone(); });
+        }
+    }
+
+    void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)> & f)
+    {
+        std::atomic<size_t> remaining(count);
+        for(size_t i=0; i<count; ++i) Submit([&f, &remaining, i]() { f(i); --remaining; });
+        Help([&remaining]() { return remaining == 0; });
+    }
+}
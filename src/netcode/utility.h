@@ -10,8 +10,16 @@
 
 #include <cstdint>
 #include <algorithm>
+#include <array>
 #include <vector>
 #include <map>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 namespace netcode
 {
@@ -22,13 +30,18 @@ namespace netcode
 		std::vector<uint8_t> & buffer;
 		int		bitIndex, underflow;
 		code_t	min, max;
+		std::vector<code_t> * tape;								// If set, receives the a, b and denom of every call to Encode(...)
 
 		void	Write(int bit);
 		void	Rescale(code_t window);
 	public:
 				ArithmeticEncoder(std::vector<uint8_t> & buffer);
 
+		size_t	GetBitCount() const { return buffer.size()*8 + bitIndex + underflow - 7; } // Number of bits written so far, including pending underflow bits
+
 		void	Encode(code_t a, code_t b, code_t denom);		// Encodes the range [a/denom, b/denom)
+		void	Record(std::vector<code_t> * tape);				// Records all subsequent calls to Encode(...) onto tape, or stops recording if tape is nullptr
+		void	Replay(const std::vector<code_t> & tape);		// Encodes all ranges recorded onto tape, which may have been recorded by a different encoder
 		void	Finish();										// Finishes off the stream
 	};
     void EncodeUniform(ArithmeticEncoder & encoder, code_t x, code_t d);
@@ -63,6 +76,7 @@ namespace netcode
         float GetExpectedCost() const;
 
         void Tally(size_t symbol);
+        void Accumulate(const SymbolDistribution & base, const SymbolDistribution & part); // Add the symbols tallied by part since it was copied from base
         void EncodeAndTally(ArithmeticEncoder & encoder, size_t symbol);
 	    size_t DecodeAndTally(ArithmeticDecoder & decoder);
     };
@@ -75,31 +89,138 @@ namespace netcode
 
         double GetAverageValue() const;
         float GetExpectedCost() const;
+        float GetCost(int value) const; // Number of bits which would be used to encode value
 
         void Tally(int value);
+        void Accumulate(const IntegerDistribution & base, const IntegerDistribution & part) { dist.Accumulate(base.dist, part.dist); }
 	    void EncodeAndTally(ArithmeticEncoder & encoder, int value);
 	    int DecodeAndTally(ArithmeticDecoder & decoder);
     };
 
+    class Int64Distribution
+    {
+        SymbolDistribution dist;        // Significant bits of non-negative values, followed by those of negative values, as for IntegerDistribution, where 31 means 31 or more
+        SymbolDistribution largeDist;   // Significant bits beyond 31 of values which need 31 or more, so that small values cost no more than they would in a 32-bit field
+    public:
+        Int64Distribution();
+
+        float GetExpectedCost() const;
+        float GetCost(int64_t value) const;
+
+        void Tally(int64_t value);
+        void Accumulate(const Int64Distribution & base, const Int64Distribution & part) { dist.Accumulate(base.dist, part.dist); largeDist.Accumulate(base.largeDist, part.largeDist); }
+        void EncodeAndTally(ArithmeticEncoder & encoder, int64_t value);
+        int64_t DecodeAndTally(ArithmeticDecoder & decoder);
+    };
+
+    class EnumDistribution
+    {
+        SymbolDistribution initialDist;                 // Values with no previous value to condition on
+        std::vector<SymbolDistribution> changeDists;    // Whether the value has changed, conditioned on the previous value
+        SymbolDistribution changedValueDist;            // Values which differ from the previous value, which is skipped over
+    public:
+        EnumDistribution() {}
+        EnumDistribution(size_t numValues);
+
+        float GetCost(int value, int prevValue) const;  // A negative prevValue indicates that there is no previous value
+        void Accumulate(const EnumDistribution & base, const EnumDistribution & part);
+        void EncodeAndTally(ArithmeticEncoder & encoder, int value, int prevValue);
+        int DecodeAndTally(ArithmeticDecoder & decoder, int prevValue);
+    };
+
+    class ArrayDistribution
+    {
+        IntegerDistribution lengthDist;                 // Change in length since the previous value
+        IntegerDistribution matchedDist;                // Residuals of elements against the element at the same index in the previous value
+        IntegerDistribution appendedDist;               // Residuals of elements beyond the end of the previous value against the preceding element
+    public:
+        // A negative prevLength indicates that there is no previous value
+        float GetCost(const int * values, int length, const int * prevValues, int prevLength) const;
+        void Accumulate(const ArrayDistribution & base, const ArrayDistribution & part);
+        void EncodeAndTally(ArithmeticEncoder & encoder, const int * values, int length, const int * prevValues, int prevLength);
+        int DecodeAndTally(ArithmeticDecoder & decoder, int * values, int capacity, const int * prevValues, int prevLength); // Returns the decoded length
+    };
+
     struct CurvePredictor 
     { 
-        int c0,c1,c2,c3,denom;
+        int64_t c0,c1,c2,c3,denom; // Coefficients are reduced to lowest terms, with a positive denominator
         CurvePredictor() : c0(),c1(),c2(),c3(),denom(1) {}
-        CurvePredictor(const int (&matrix)[4][4]);
-        int operator()(const int (&samples)[4]) const { return (c0*samples[0] + c1*samples[1] + c2*samples[2] + c3*samples[3])/denom; }
+        CurvePredictor(const int64_t (&matrix)[4][4]);
+        bool IsSafe() const; // Whether operator() is guaranteed not to overflow for any samples
+        int operator()(const int (&samples)[4]) const { return static_cast<int>((c0*samples[0] + c1*samples[1] + c2*samples[2] + c3*samples[3])/denom); }
+        int64_t operator()(const int64_t (&samples)[4]) const; // Evaluated on the differences from the first sample, falling back to the first sample if they exceed 32 bits
     };
     CurvePredictor MakeConstantPredictor();
     CurvePredictor MakeLinearPredictor(int t0, int t1);
     CurvePredictor MakeQuadraticPredictor(int t0, int t1, int t2);
     CurvePredictor MakeCubicPredictor(int t0, int t1, int t2, int t3);
 
+    class PredictorCache
+    {
+        std::mutex mutex;
+        std::map<std::array<int,4>, std::array<CurvePredictor,5>> predictors;
+    public:
+        // Obtains the zero, constant, linear, quadratic and cubic predictors for samples taken the given number of frames ago, or 0 for missing samples
+        void GetPredictors(const int (&frameDeltas)[4], CurvePredictor (&predictors)[5]);
+    };
+
     struct FieldDistribution
     {
-        IntegerDistribution dists[5];
+        std::vector<IntegerDistribution> dists; // Distributions of the residuals of the five curve predictors, followed by those of any custom predictors, which are always available
+        int warmup;                             // Number of consecutive values for which the best predictor must remain unchanged before it is locked in, or 0 to never lock
+        int candidateDist, stableCount;         // The best predictor when all curve predictors were last available, and for how many consecutive values it has been the best
+        int lockedDist;                         // The predictor which has been locked in, or -1 if none, after which the other distributions are no longer tallied
+
+        FieldDistribution(size_t customPredictors = 0, int warmup = 0) : dists(5 + customPredictors), warmup(warmup), candidateDist(-1), stableCount(0), lockedDist(-1) {}
+
+        int GetBestDistribution(int sampleCount) const;
+        int SelectDistribution(int sampleCount) const; // Returns the locked distribution if its predictor is available, or the best distribution otherwise
+        void TallyOthers(int value, const int * predictions, int sampleCount, int selected);
+        // Predictions holds the prediction of each predictor, of which only the first sampleCount+1 curve predictors and all custom predictors are used
+        float GetCost(int value, const int * predictions, int sampleCount) const;
+        void Accumulate(const FieldDistribution & base, const FieldDistribution & part);
+        void EncodeAndTally(ArithmeticEncoder & encoder, int value, const int * predictions, int sampleCount);
+        int DecodeAndTally(ArithmeticDecoder & decoder, const int * predictions, int sampleCount);
+    };
+
+    struct Int64FieldDistribution
+    {
+        std::vector<Int64Distribution> dists;   // Distributions of the residuals of the five curve predictors, which are taken modulo 2^64
+
+        Int64FieldDistribution() : dists(5) {}
 
         int GetBestDistribution(int sampleCount) const;
-        void EncodeAndTally(ArithmeticEncoder & encoder, int value, const int (&prevValues)[4], const CurvePredictor (&predictors)[5], int sampleCount);
-        int DecodeAndTally(ArithmeticDecoder & decoder, const int (&prevValues)[4], const CurvePredictor (&predictors)[5], int sampleCount);
+        // Predictions holds the prediction of each curve predictor, of which only the first sampleCount+1 are used
+        float GetCost(int64_t value, const int64_t * predictions, int sampleCount) const;
+        void Accumulate(const Int64FieldDistribution & base, const Int64FieldDistribution & part);
+        void EncodeAndTally(ArithmeticEncoder & encoder, int64_t value, const int64_t * predictions, int sampleCount);
+        int64_t DecodeAndTally(ArithmeticDecoder & decoder, const int64_t * predictions, int sampleCount);
+    };
+
+    class VecDistribution
+    {
+        struct Model
+        {
+            SymbolDistribution lengthDist;      // Significant bits of the largest residual across all components
+            std::vector<SymbolDistribution> componentDists; // Sign of each component's residual, and how many fewer significant bits it has than the largest (up to 7), for each component and each length up to 7
+            int64_t totalBits, count;           // Total significant bits of all residuals tallied so far, and how many vectors they came from
+
+            static int GetLength(const int * values, int components, const int * predictions);
+            void TallyTotals(const int * values, int components, const int * predictions);
+            void Tally(const int * values, int components, const int * predictions);
+        };
+        std::vector<Model> models;              // One model per curve predictor, all of which share the same selection across components
+        
+        int SelectModel(int sampleCount) const; // Returns the available predictor whose residuals have had the fewest significant bits on average
+    public:
+        VecDistribution() {}
+        VecDistribution(int components);
+
+        // Predictions holds the prediction of curve predictor i for component k at [i*stride + k], of which only the first sampleCount+1 predictors are used
+        float GetCost(const int * values, int components, const int * predictions, size_t stride, int sampleCount) const;
+        void Accumulate(const VecDistribution & base, const VecDistribution & part);
+        void EncodeAndTally(ArithmeticEncoder & encoder, const int * values, int components, const int * predictions, size_t stride, int sampleCount);
+        void DecodeAndTally(ArithmeticDecoder & decoder, int * values, int components, const int * predictions, size_t stride, int sampleCount);
     };
 
     class RangeAllocator
@@ -115,6 +236,60 @@ namespace netcode
         void Free(size_t offset, size_t amount);
     };
 
+    class BlobTable
+    {
+        mutable std::mutex mutex;
+        std::deque<std::vector<uint8_t>> blobs;         // Contents of each blob, which are never moved once added, and are cleared once evicted
+        std::map<std::vector<uint8_t>, int> handles;    // Handle of each blob which has not been evicted, indexed by its contents
+        mutable std::vector<int> refCounts;             // Number of references held to each blob, which may be taken by readers of the table
+        mutable std::vector<int> unreferenced;          // Handles of blobs whose last reference was released, or which were added without one, since the last call to Collect()
+        std::vector<int> freeHandles;                   // Handles of evicted blobs, which are reused before any new handles
+    public:
+        BlobTable();                                    // The empty blob always has handle 0, and is never evicted
+
+        size_t GetBlobCount() const;                    // Returns the number of blobs which have not been evicted, including the empty blob
+        const std::vector<uint8_t> & Get(int handle) const;
+        int Intern(const uint8_t * data, size_t size);  // Returns the handle of a blob with the given contents, adding it if it does not yet exist
+        void AddRefs(const int * handles, size_t count) const;
+        void ReleaseRefs(const int * handles, size_t count) const;
+        void Collect();                                 // Evicts every blob without references, which must not be called while any handle without a reference may still be used
+    };
+
+    // References held to a set of blobs in a BlobTable, which are released when this is destroyed
+    class BlobRefs
+    {
+        const BlobTable * table;
+        std::vector<int> handles;
+    public:
+        BlobRefs() : table() {}
+        BlobRefs(const BlobTable & table, std::vector<int> handles) : table(&table), handles(move(handles)) { table.AddRefs(this->handles.data(), this->handles.size()); }
+        BlobRefs(BlobRefs && r) : table(r.table), handles(move(r.handles)) { r.table = nullptr; }
+        BlobRefs & operator = (BlobRefs && r) { std::swap(table, r.table); std::swap(handles, r.handles); return *this; }
+        ~BlobRefs() { if(table) table->ReleaseRefs(handles.data(), handles.size()); }
+    };
+
+    class ThreadPool
+    {
+        struct Queue { std::mutex mutex; std::deque<std::function<void()>> tasks; };
+
+        std::vector<std::unique_ptr<Queue>> queues;         // One queue of tasks per worker thread, from which idle workers may steal
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable wake;                       // Signalled when tasks are submitted, or the pool is stopping
+        std::condition_variable finished;                   // Signalled when a task finishes, for threads waiting in Help(...)
+        std::atomic<size_t> pendingTasks, nextQueue;
+        bool isStopping;
+
+        bool RunTask(size_t queue);                         // Runs a task from the given queue, or steals one from another queue, returning false if none were available
+    public:
+        ThreadPool(size_t threadCount);
+        ~ThreadPool();
+
+        void Submit(std::function<void()> task);
+        void Help(const std::function<bool()> & isDone);    // Runs tasks on the calling thread until isDone() returns true
+        void ParallelFor(size_t count, const std::function<void(size_t)> & f);
+    };
+
     template<class T> size_t GetIndex(const std::vector<T> & vec, const T & value) { return std::find(begin(vec), end(vec), value) - begin(vec); }
     template<class T> void Erase(std::vector<T> & vec, const T & value) { vec.erase(std::find(begin(vec), end(vec), value)); }
     template<class T> void EraseBefore(std::map<int, T> & map, int key) { map.erase(begin(map), map.lower_bound(key)); }
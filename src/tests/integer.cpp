@@ -68,4 +68,53 @@ TEST_CASE( "The full range of integers can be encoded losslessly", "[integer dis
     TestSingleInt(29873123);
     TestSingleInt(INT_MAX);
     TestSingleInt(INT_MIN);
-}
\ No newline at end of file
+}
+
+TEST_CASE( "The full range of 64-bit integers can be encoded losslessly", "[integer distribution]" )
+{
+    const int64_t values[] = {0, +1, -1, -452, INT_MAX, int64_t(INT_MAX)+1, INT_MIN, int64_t(INT_MIN)-1, 1450000000000, -98765432109876543, INT64_MAX, INT64_MIN};
+    std::vector<uint8_t> buffer;
+    ArithmeticEncoder encoder(buffer);
+    Int64Distribution encoderDist;
+    for(auto value : values) encoderDist.EncodeAndTally(encoder, value);
+    encoder.Finish();
+
+    ArithmeticDecoder decoder(buffer);
+    Int64Distribution decoderDist;
+    for(auto value : values) REQUIRE( decoderDist.DecodeAndTally(decoder) == value );
+}
+TEST_CASE( "Vectors with components of very different magnitudes are encoded and decoded correctly", "[vec distribution]" )
+{
+    // Generate vectors whose components span the range of the data type, along with predictions for each curve predictor
+    std::vector<int> values, predictions;
+    std::mt19937 engine(0);
+    std::uniform_real_distribution<double> r(-1, 1);
+	for (int i = 0; i < 1000 * 3; ++i)
+	{
+        values.push_back(static_cast<int>(r(engine) * r(engine) * r(engine) * INT_MAX) >> (i % 3 * 12));
+    }
+    for (int i = 0; i < 1000; ++i) for(int j = 0; j < 5; ++j) for(int k = 0; k < 3; ++k)
+    {
+        predictions.push_back(values[i*3 + k] + static_cast<int>(r(engine) * (1 << j*4)));
+    }
+
+    // Encode the vectors while building up a distribution, using predictions laid out as by Frameset::PredictFields(...)
+    std::vector<uint8_t> buffer;
+	ArithmeticEncoder encoder(buffer);
+    VecDistribution encoderDist(3);
+    for(int i=0; i<1000; ++i)
+    {
+        encoderDist.EncodeAndTally(encoder, values.data() + i*3, 3, predictions.data() + i*15, 3, i % 5);
+    }
+    encoder.Finish();
+
+    // Decode the vectors, and build up the same distribution
+	ArithmeticDecoder decoder(buffer);
+    VecDistribution decoderDist(3);
+    for(int i=0; i<1000; ++i)
+    {
+        int decodedValues[3];
+        decoderDist.DecodeAndTally(decoder, decodedValues, 3, predictions.data() + i*15, 3, i % 5);
+        for(int k=0; k<3; ++k) REQUIRE( decodedValues[k] == values[i*3 + k] );
+    }
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2015 Sterling Orsten
+//   This software is provided 'as-is', without any express or implied
+// warranty. In no event will the author be held liable for any damages
+// arising from the use of this software. You are granted a perpetual, 
+// irrevocable, world-wide license to copy, modify, and redistribute
+// this software for any purpose, including commercial applications.
+
+#include "thirdparty/catch.hpp"
+#include "utility.h"
+#include <climits>
+
+using namespace netcode;
+
+TEST_CASE( "Curve predictors extrapolate polynomials exactly", "[curve predictor]" )
+{
+    // Sample a cubic polynomial at several frames in the past, and predict its value on the current frame
+    auto f = [](int t) { return 1000 - 7*t + 3*t*t - 2*t*t*t; };
+    const int frameDeltas[4] = {1, 3, 4, 7};
+    const int samples[4] = {f(-1), f(-3), f(-4), f(-7)};
+
+    PredictorCache cache;
+    CurvePredictor predictors[5];
+    cache.GetPredictors(frameDeltas, predictors);
+    REQUIRE( predictors[0](samples) == 0 );
+    REQUIRE( predictors[1](samples) == samples[0] );
+    REQUIRE( predictors[4](samples) == f(0) );
+
+    // Coefficients are reduced to lowest terms
+    const int linearDeltas[4] = {1, 2, 0, 0};
+    cache.GetPredictors(linearDeltas, predictors);
+    REQUIRE( predictors[2].c0 == 2 );
+    REQUIRE( predictors[2].c1 == -1 );
+    REQUIRE( predictors[2].denom == 1 );
+    REQUIRE( predictors[3](samples) == samples[0] ); // Missing samples fall back to the constant predictor
+}
+
+TEST_CASE( "Cached curve predictors match those constructed directly", "[curve predictor]" )
+{
+    PredictorCache cache;
+    for(int a=1; a<8; ++a) for(int b=a+1; b<10; ++b) for(int c=b+1; c<12; ++c) for(int d=c+1; d<14; ++d)
+    {
+        const int frameDeltas[4] = {a, b, c, d};
+        CurvePredictor predictors[5];
+        cache.GetPredictors(frameDeltas, predictors);
+        auto cubic = MakeCubicPredictor(a, b, c, d);
+        REQUIRE( (predictors[4].c0 * cubic.denom) == (cubic.c0 * predictors[4].denom) );
+        REQUIRE( (predictors[4].c3 * cubic.denom) == (cubic.c3 * predictors[4].denom) );
+        REQUIRE( predictors[4].IsSafe() );
+    }
+}
+
+TEST_CASE( "Curve predictors do not overflow for extreme samples", "[curve predictor]" )
+{
+    PredictorCache cache;
+    const int frameDeltas[4] = {1, 2, 3, 4}, samples[4] = {INT_MAX, INT_MIN, INT_MAX, INT_MIN};
+    CurvePredictor predictors[5];
+    cache.GetPredictors(frameDeltas, predictors);
+    REQUIRE( predictors[4].c0 == 4 );
+    REQUIRE( predictors[4].c1 == -6 );
+    REQUIRE( predictors[4].c2 == 4 );
+    REQUIRE( predictors[4].c3 == -1 );
+    REQUIRE( int64_t(predictors[4](samples)) == int(int64_t(INT_MAX)*8 - int64_t(INT_MIN)*7) ); // The result wraps, but the intermediate sum does not overflow
+}
+
+TEST_CASE( "Predictor selection is locked in after warmup, identically by encoder and decoder", "[field distribution]" )
+{
+    // Encode a field moving in a straight line, and then accelerating, with predictions from the constant, linear, quadratic and cubic predictors
+    auto getPredictions = [](int i, int (&predictions)[5])
+    {
+        auto f = [](int t) { return 5 + t*3 + (t > 100 ? (t-100)*(t-100) : 0); };
+        const int linear = 2*f(i-1) - f(i-2), quadratic = 3*f(i-1) - 3*f(i-2) + f(i-3), cubic = 4*f(i-1) - 6*f(i-2) + 4*f(i-3) - f(i-4);
+        const int p[5] = {0, f(i-1), linear, quadratic, cubic};
+        std::copy(p, p+5, predictions);
+        return f(i);
+    };
+    FieldDistribution encodeDist(0, 20), decodeDist(0, 20), lockedDist;
+    std::vector<uint8_t> buffer;
+    ArithmeticEncoder encoder(buffer);
+    for(int i=0; i<150; ++i)
+    {
+        int predictions[5];
+        const int value = getPredictions(i, predictions);
+        encodeDist.EncodeAndTally(encoder, value, predictions, 4);
+        if(encodeDist.lockedDist >= 0 && lockedDist.lockedDist < 0) lockedDist = encodeDist;
+    }
+    encoder.Finish();
+    REQUIRE( encodeDist.lockedDist == 2 );
+
+    ArithmeticDecoder decoder(buffer);
+    for(int i=0; i<150; ++i)
+    {
+        int predictions[5];
+        const int value = getPredictions(i, predictions);
+        REQUIRE( decodeDist.DecodeAndTally(decoder, predictions, 4) == value );
+    }
+    REQUIRE( decodeDist.lockedDist == 2 );
+
+    // Once locked, only the locked distribution is tallied, so the others keep the counts they had when it was locked, even once they would predict better
+    std::vector<int> residuals = {0};
+    for(int bits=0; bits<31; ++bits) residuals.insert(end(residuals), {1 << bits, -(1 << bits) - 1}); // One residual for each bucket of an IntegerDistribution
+    for(size_t j=0; j<encodeDist.dists.size(); ++j)
+    {
+        bool isUnchanged = true;
+        for(auto r : residuals) isUnchanged &= encodeDist.dists[j].GetCost(r) == lockedDist.dists[j].GetCost(r);
+        REQUIRE( isUnchanged == (j != 2) );
+    }
+}
@@ -0,0 +1,1376 @@
+// Copyright (c) 2015 Sterling Orsten
+//   This software is provided 'as-is', without any express or implied
+// warranty. In no event will the author be held liable for any damages
+// arising from the use of this software. You are granted a perpetual, 
+// irrevocable, world-wide license to copy, modify, and redistribute
+// this software for any purpose, including commercial applications.
+
+#include "thirdparty/catch.hpp"
+#include "implementation.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+// A server and a client authority, connected to each other by a pair of peers
+struct Loopback
+{
+    NCprotocol * protocol;
+    NCclass * unitClass;
+    NCint * unitTag, * unitX, * unitY;
+    NCauthority * serverAuth, * clientAuth;
+    NCpeer * serverPeer, * clientPeer;
+    std::vector<NCobject *> units;
+    std::mt19937 engine;
+    int largestPart;
+    std::function<void()> onClientMessage;  // Called after the client consumes each message, or each part of a split message
+
+    // Classes are defined by the given function if there is one, and otherwise a single unit class is defined
+    Loopback(const std::function<void(NCprotocol *)> & defineClasses = nullptr) : unitClass(), unitTag(), unitX(), unitY(), engine(0), largestPart(0)
+    {
+        protocol = ncCreateProtocol(30);
+        if(defineClasses) defineClasses(protocol);
+        else
+        {
+            unitClass = ncCreateClass(protocol, 0);
+            unitTag = ncCreateInt(unitClass, NC_CONST_FIELD_FLAG);
+            unitX = ncCreateInt(unitClass, 0);
+            unitY = ncCreateInt(unitClass, 0);
+        }
+        serverAuth = ncCreateAuthority(protocol);
+        clientAuth = ncCreateAuthority(protocol);
+        serverPeer = ncCreatePeer(serverAuth);
+        clientPeer = ncCreatePeer(clientAuth);
+    }
+
+    ~Loopback()
+    {
+        ncDestroyPeer(serverPeer);
+        ncDestroyPeer(clientPeer);
+        ncDestroyAuthority(serverAuth);
+        ncDestroyAuthority(clientAuth);
+        ncDestroyProtocol(protocol);
+    }
+
+    // Create an object on the server which is visible to the client
+    NCobject * Spawn(const NCclass * cl)
+    {
+        auto object = ncCreateLocalObject(serverAuth, cl);
+        ncSetVisibility(serverPeer, object, 1);
+        return object;
+    }
+
+    void SpawnUnits(int count)
+    {
+        for(int i=0; i<count; ++i)
+        {
+            auto unit = Spawn(unitClass);
+            ncSetObjectInt(unit, unitTag, units.size());
+            units.push_back(unit);
+        }
+    }
+
+    void MoveUnits(int frame)
+    {
+        for(size_t i=0; i<units.size(); ++i)
+        {
+            ncSetObjectInt(units[i], unitX, frame * (i % 7) + i);
+            ncSetObjectInt(units[i], unitY, frame * (i % 5) - i);
+        }
+    }
+
+    // Publish a frame on both authorities and exchange messages, returning the total size of the server's message
+    int Exchange(double lossRate)
+    {
+        std::uniform_real_distribution<double> r(0, 1);
+        ncPublishFrame(serverAuth);
+        ncPublishFrame(clientAuth);
+
+        // Parts of a split message may arrive in any order
+        auto update = ncProduceMessage(serverPeer);
+        std::vector<const NCblob *> parts;
+        for(auto part = (const NCblob *)update; part; part = ncGetNextBlob(part)) parts.push_back(part);
+        std::shuffle(begin(parts), end(parts), engine);
+        int size = 0;
+        for(auto part : parts)
+        {
+            size += ncGetBlobSize(part);
+            largestPart = std::max(largestPart, ncGetBlobSize(part));
+            if(r(engine) >= lossRate)
+            {
+                ncConsumeMessage(clientPeer, ncGetBlobData(part), ncGetBlobSize(part));
+                if(onClientMessage) onClientMessage();
+            }
+        }
+        ncFreeBlob(update);
+
+        auto response = ncProduceMessage(clientPeer);
+        if(r(engine) >= lossRate) ncConsumeMessage(serverPeer, ncGetBlobData(response), ncGetBlobSize(response));
+        ncFreeBlob(response);
+        return size;
+    }
+
+    // Require that the client's views of all units match the server's objects
+    void RequireSynchronized()
+    {
+        int count = 0;
+        for(int i=0, n=ncGetRemoteObjectCount(clientPeer); i<n; ++i)
+        {
+            auto view = ncGetRemoteObject(clientPeer, i);
+            if(ncGetObjectClass(view) != unitClass) continue;
+            auto unit = units[ncGetObjectInt(view, unitTag)];
+            REQUIRE( ncGetObjectInt(view, unitX) == ncGetObjectInt(unit, unitX) );
+            REQUIRE( ncGetObjectInt(view, unitY) == ncGetObjectInt(unit, unitY) );
+            ++count;
+        }
+        REQUIRE( count == units.size() );
+    }
+};
+
+TEST_CASE( "Objects are replicated correctly over a lossy connection", "[protocol]" )
+{
+    Loopback loop;
+    loop.SpawnUnits(50);
+    for(int i=0; i<200; ++i)
+    {
+        loop.MoveUnits(i);
+        loop.Exchange(0.2);
+    }
+    for(int i=0; i<3; ++i) loop.Exchange(0);
+    loop.RequireSynchronized();
+}
+
+TEST_CASE( "Remote objects can be sampled between retained frames and extrapolated beyond the newest frame", "[protocol]" )
+{
+    Loopback loop;
+    loop.SpawnUnits(10);
+    for(int i=0; i<40; ++i)
+    {
+        loop.MoveUnits(i);
+        loop.Exchange(0.3);
+    }
+
+    // Units move in straight lines, which are interpolated exactly across lost frames, and extrapolated exactly by the linear predictor
+    const int newest = ncGetRemoteFrame(loop.clientPeer);
+    REQUIRE( newest > 30 );
+    for(int i=0, n=ncGetRemoteObjectCount(loop.clientPeer); i<n; ++i)
+    {
+        auto view = ncGetRemoteObject(loop.clientPeer, i);
+        const int tag = ncGetObjectInt(view, loop.unitTag);
+        auto expectedX = [=](double frame) { return (frame - 1) * (tag % 7) + tag; }; // MoveUnits(i) is published on frame i+1
+        REQUIRE( ncGetObjectIntAt(view, loop.unitX, newest) == ncGetObjectInt(view, loop.unitX) );
+        REQUIRE( std::abs(ncGetObjectIntAt(view, loop.unitX, newest - 2.5) - expectedX(newest - 2.5)) < 1e-6 );
+        REQUIRE( std::abs(ncGetObjectIntAt(view, loop.unitX, newest + 1.25) - expectedX(newest + 1.25)) < 1e-6 );
+        REQUIRE( ncGetObjectIntAt(view, loop.unitTag, newest + 1.25) == tag );
+
+        const NCint * fields[] = {loop.unitX, loop.unitY};
+        double values[2];
+        ncGetObjectIntsAt(view, fields, 2, newest - 0.5, values);
+        REQUIRE( values[0] == ncGetObjectIntAt(view, loop.unitX, newest - 0.5) );
+        REQUIRE( values[1] == ncGetObjectIntAt(view, loop.unitY, newest - 0.5) );
+    }
+
+    // Local objects have no history, and report their current values
+    REQUIRE( ncGetObjectIntAt(loop.units[3], loop.unitX, 1) == ncGetObjectInt(loop.units[3], loop.unitX) );
+}
+
+TEST_CASE( "Created, destroyed, and changed lists describe every change made by each message", "[protocol]" )
+{
+    Loopback loop;
+    std::mt19937 engine(1);
+    std::map<const NCobject *, std::pair<int,int>> mirror; // Client's copy of each view, maintained only from the change lists
+    loop.onClientMessage = [&]()
+    {
+        for(int j=0, n=ncGetDestroyedCount(loop.clientPeer); j<n; ++j)
+        {
+            // Destroyed views still hold the values they had before the message
+            auto view = ncGetDestroyedObject(loop.clientPeer, j);
+            REQUIRE( mirror.count(view) == 1 );
+            REQUIRE( mirror[view].first == ncGetObjectInt(view, loop.unitX) );
+            REQUIRE( mirror[view].second == ncGetObjectInt(view, loop.unitY) );
+            mirror.erase(view);
+        }
+        for(int j=0, n=ncGetCreatedCount(loop.clientPeer); j<n; ++j)
+        {
+            auto view = ncGetCreatedObject(loop.clientPeer, j);
+            REQUIRE( mirror.count(view) == 0 );
+            mirror[view] = {ncGetObjectInt(view, loop.unitX), ncGetObjectInt(view, loop.unitY)};
+        }
+        for(int j=0, n=ncGetChangedCount(loop.clientPeer); j<n; ++j)
+        {
+            auto view = ncGetChangedObject(loop.clientPeer, j);
+            REQUIRE( mirror.count(view) == 1 );
+            auto & values = mirror[view];
+            const int x = ncGetObjectInt(view, loop.unitX), y = ncGetObjectInt(view, loop.unitY);
+            REQUIRE( (values.first != x || values.second != y) );
+            REQUIRE( !!ncHasIntChanged(loop.clientPeer, j, loop.unitX) == (values.first != x) );
+            REQUIRE( !!ncHasIntChanged(loop.clientPeer, j, loop.unitY) == (values.second != y) );
+            REQUIRE( ncHasIntChanged(loop.clientPeer, j, loop.unitTag) == 0 );
+            values = {x, y};
+        }
+
+        // The views maintained from the change lists match a full scan of the remote objects
+        REQUIRE( mirror.size() == ncGetRemoteObjectCount(loop.clientPeer) );
+        for(int j=0, n=ncGetRemoteObjectCount(loop.clientPeer); j<n; ++j)
+        {
+            auto view = ncGetRemoteObject(loop.clientPeer, j);
+            REQUIRE( mirror.count(view) == 1 );
+            REQUIRE( mirror[view].first == ncGetObjectInt(view, loop.unitX) );
+            REQUIRE( mirror[view].second == ncGetObjectInt(view, loop.unitY) );
+        }
+    };
+
+    // Split messages arrive in any order, and a long outage forces a keyframe
+    SECTION( "whole messages" ) {}
+    SECTION( "split messages" ) { ncSetMaxMessageSize(loop.serverPeer, 200); }
+    for(int i=0; i<240; ++i)
+    {
+        // Spawn and destroy units, and move a third of them, until the last few frames
+        if(i < 220)
+        {
+            loop.SpawnUnits(2);
+            auto victim = begin(loop.units) + std::uniform_int_distribution<size_t>(0, loop.units.size()-1)(engine);
+            if(i % 2 == 0) { ncDestroyObject(*victim); loop.units.erase(victim); }
+            for(size_t j=i%3; j<loop.units.size(); j+=3) ncSetObjectInt(loop.units[j], j%2 ? loop.unitX : loop.unitY, i*10+j);
+        }
+        loop.Exchange(i >= 100 && i < 140 ? 1 : i < 230 ? 0.2 : 0);
+    }
+
+    // Once objects stop changing, messages report no changes at all
+    REQUIRE( ncGetCreatedCount(loop.clientPeer) == 0 );
+    REQUIRE( ncGetDestroyedCount(loop.clientPeer) == 0 );
+    REQUIRE( ncGetChangedCount(loop.clientPeer) == 0 );
+}
+
+TEST_CASE( "Objects destroyed in the same message as a keyframe can still be read", "[protocol]" )
+{
+    Loopback loop;
+    loop.SpawnUnits(3);
+    for(int i=0; i<10; ++i)
+    {
+        loop.MoveUnits(i);
+        loop.Exchange(0);
+    }
+    const int lastX = ncGetObjectInt(loop.units[1], loop.unitX), lastY = ncGetObjectInt(loop.units[1], loop.unitY);
+    REQUIRE( lastX != 0 );
+
+    // An outage longer than maxFrameDelta forces a keyframe, which omits the destroyed unit and carries no state for it
+    ncDestroyObject(loop.units[1]);
+    loop.units.erase(begin(loop.units) + 1);
+    for(int i=10; i<50; ++i)
+    {
+        loop.MoveUnits(i);
+        loop.Exchange(1);
+    }
+    loop.Exchange(0);
+
+    REQUIRE( ncGetDestroyedCount(loop.clientPeer) == 1 );
+    auto view = ncGetDestroyedObject(loop.clientPeer, 0);
+    REQUIRE( ncGetObjectInt(view, loop.unitTag) == 1 );
+    REQUIRE( ncGetObjectInt(view, loop.unitX) == lastX );
+    REQUIRE( ncGetObjectInt(view, loop.unitY) == lastY );
+    REQUIRE( ncGetObjectIntAt(view, loop.unitX, ncGetRemoteFrame(loop.clientPeer) + 0.5) == lastX );
+    loop.RequireSynchronized();
+}
+
+TEST_CASE( "Fields of every remote object of a class can be read in a single call", "[protocol]" )
+{
+    Loopback loop;
+    loop.SpawnUnits(50);
+    for(int i=0; i<50; ++i)
+    {
+        loop.MoveUnits(i);
+        if(i % 10 == 0) { ncDestroyObject(loop.units.back()); loop.units.pop_back(); }
+        loop.Exchange(0.3);
+
+        // Bulk reads return the same values as reading each object in turn, in the order of ncGetRemoteObject(...)
+        const int count = ncGetRemoteObjects(loop.clientPeer, loop.unitClass, nullptr);
+        REQUIRE( count == ncGetRemoteObjectCount(loop.clientPeer) );
+        REQUIRE( ncGetRemoteInts(loop.clientPeer, loop.unitX, nullptr) == count );
+        std::vector<const NCobject *> views(count);
+        std::vector<int> tags(count), xs(count), ys(count);
+        REQUIRE( ncGetRemoteObjects(loop.clientPeer, loop.unitClass, views.data()) == count );
+        REQUIRE( ncGetRemoteInts(loop.clientPeer, loop.unitTag, tags.data()) == count );
+        REQUIRE( ncGetRemoteInts(loop.clientPeer, loop.unitX, xs.data()) == count );
+        REQUIRE( ncGetRemoteInts(loop.clientPeer, loop.unitY, ys.data()) == count );
+        for(int j=0; j<count; ++j)
+        {
+            REQUIRE( views[j] == ncGetRemoteObject(loop.clientPeer, j) );
+            REQUIRE( tags[j] == ncGetObjectInt(views[j], loop.unitTag) );
+            REQUIRE( xs[j] == ncGetObjectInt(views[j], loop.unitX) );
+            REQUIRE( ys[j] == ncGetObjectInt(views[j], loop.unitY) );
+        }
+    }
+    for(int i=0; i<3; ++i) loop.Exchange(0);
+    loop.RequireSynchronized();
+}
+
+TEST_CASE( "Bandwidth budgets defer low priority updates without desynchronizing the remote peer", "[protocol]" )
+{
+    Loopback loop;
+    loop.SpawnUnits(200);
+    for(int i=0; i<5; ++i) loop.Exchange(0);
+
+    // Once all units have been created, updates should fit within the budget
+    ncSetBandwidthBudget(loop.serverPeer, 100);
+    for(size_t i=0; i<loop.units.size(); i+=10) ncSetObjectPriority(loop.units[i], 10);
+    for(int i=5; i<200; ++i)
+    {
+        loop.MoveUnits(i);
+        REQUIRE( loop.Exchange(0.2) <= 100 );
+    }
+
+    // Deferred objects should eventually be brought up to date
+    for(int i=0; i<50; ++i) loop.Exchange(0);
+    loop.RequireSynchronized();
+}
+
+TEST_CASE( "Large updates are split into parts which fit within the maximum message size", "[protocol]" )
+{
+    Loopback loop;
+    ncSetMaxMessageSize(loop.serverPeer, 200);
+    loop.SpawnUnits(500);
+    for(int i=0; i<100; ++i)
+    {
+        if(i == 50) loop.SpawnUnits(100);
+        loop.MoveUnits(i);
+        loop.Exchange(0.1);
+    }
+    REQUIRE( loop.largestPart <= 200 );
+
+    // Once every part of a message has arrived, the frame can be used to predict subsequent updates
+    for(int i=0; i<3; ++i) loop.Exchange(0);
+    loop.RequireSynchronized();
+}
+
+TEST_CASE( "Messages produced in parallel are identical to messages produced serially", "[protocol]" )
+{
+    // Set up two identical authorities, each with many peers
+    Loopback serial, parallel;
+    std::vector<NCpeer *> serialPeers, parallelPeers;
+    for(int i=0; i<32; ++i)
+    {
+        serialPeers.push_back(ncCreatePeer(serial.serverAuth));
+        parallelPeers.push_back(ncCreatePeer(parallel.serverAuth));
+    }
+    serial.SpawnUnits(100);
+    parallel.SpawnUnits(100);
+    for(int i=0; i<100; ++i)
+    {
+        ncSetVisibility(serialPeers[i % 32], serial.units[i], 1);
+        ncSetVisibility(parallelPeers[i % 32], parallel.units[i], 1);
+    }
+
+    std::vector<NCblob *> blobs(parallelPeers.size());
+    for(int i=0; i<10; ++i)
+    {
+        serial.MoveUnits(i);
+        parallel.MoveUnits(i);
+        ncPublishFrame(serial.serverAuth);
+        ncPublishFrame(parallel.serverAuth);
+
+        ncProduceMessages(parallel.serverAuth, parallelPeers.data(), parallelPeers.size(), blobs.data());
+        for(size_t j=0; j<serialPeers.size(); ++j)
+        {
+            auto blob = ncProduceMessage(serialPeers[j]);
+            REQUIRE( ncGetBlobSize(blobs[j]) == ncGetBlobSize(blob) );
+            REQUIRE( memcmp(ncGetBlobData(blobs[j]), ncGetBlobData(blob), ncGetBlobSize(blob)) == 0 );
+            ncFreeBlob(blob);
+            ncFreeBlob(blobs[j]);
+        }
+    }
+
+    for(auto peer : serialPeers) ncDestroyPeer(peer);
+    for(auto peer : parallelPeers) ncDestroyPeer(peer);
+}
+
+TEST_CASE( "Frames published asynchronously can be encoded while the next frame is simulated", "[protocol]" )
+{
+    Loopback loop;
+    loop.SpawnUnits(50);
+    for(int i=0; i<100; ++i)
+    {
+        loop.MoveUnits(i);
+        ncPublishFrameAsync(loop.serverAuth, &loop.serverPeer, 1);
+
+        // Simulate the next frame, replacing one of the units, while the previous frame is being encoded
+        auto & unit = loop.units[i % loop.units.size()];
+        ncDestroyObject(unit);
+        unit = ncCreateLocalObject(loop.serverAuth, loop.unitClass);
+        ncSetObjectInt(unit, loop.unitTag, i % loop.units.size());
+        ncSetVisibility(loop.serverPeer, unit, 1);
+        loop.MoveUnits(i+1);
+
+        NCblob * update;
+        ncCollectMessages(loop.serverAuth, &update);
+        ncConsumeMessage(loop.clientPeer, ncGetBlobData(update), ncGetBlobSize(update));
+        ncFreeBlob(update);
+
+        ncPublishFrame(loop.clientAuth);
+        auto response = ncProduceMessage(loop.clientPeer);
+        ncConsumeMessage(loop.serverPeer, ncGetBlobData(response), ncGetBlobSize(response));
+        ncFreeBlob(response);
+    }
+    loop.Exchange(0);
+    loop.RequireSynchronized();
+}
+
+TEST_CASE( "Messages from many clients can be consumed in parallel", "[protocol]" )
+{
+    // Each client owns a cursor object which is visible to the server, which holds references to each cursor
+    auto protocol = ncCreateProtocol(5);
+    auto cursorClass = ncCreateClass(protocol, 0), playerClass = ncCreateClass(protocol, 0);
+    auto cursorX = ncCreateInt(cursorClass, 0);
+    auto playerCursor = ncCreateRef(playerClass);
+    auto serverAuth = ncCreateAuthority(protocol);
+    std::vector<NCauthority *> clientAuths;
+    std::vector<NCpeer *> serverPeers, clientPeers;
+    std::vector<NCobject *> cursors, players;
+    for(int i=0; i<16; ++i)
+    {
+        clientAuths.push_back(ncCreateAuthority(protocol));
+        clientPeers.push_back(ncCreatePeer(clientAuths[i]));
+        serverPeers.push_back(ncCreatePeer(serverAuth));
+        cursors.push_back(ncCreateLocalObject(clientAuths[i], cursorClass));
+        ncSetVisibility(clientPeers[i], cursors[i], 1);
+        players.push_back(ncCreateLocalObject(serverAuth, playerClass));
+    }
+
+    std::vector<NCblob *> blobs(clientPeers.size());
+    std::vector<const void *> data(clientPeers.size());
+    std::vector<int> sizes(clientPeers.size());
+    for(int frame=0; frame<30; ++frame)
+    {
+        // Clients move their cursors, and destroy them partway through
+        for(size_t i=0; i<clientPeers.size(); ++i)
+        {
+            if(frame == 20) ncDestroyObject(cursors[i]);
+            else if(frame < 20) ncSetObjectInt(cursors[i], cursorX, frame * i);
+            ncPublishFrame(clientAuths[i]);
+            blobs[i] = ncProduceMessage(clientPeers[i]);
+            data[i] = ncGetBlobData(blobs[i]);
+            sizes[i] = ncGetBlobSize(blobs[i]);
+        }
+        ncConsumeMessages(serverAuth, serverPeers.data(), data.data(), sizes.data(), serverPeers.size());
+        for(auto blob : blobs) ncFreeBlob(blob);
+
+        for(size_t i=0; i<serverPeers.size(); ++i)
+        {
+            if(frame < 20)
+            {
+                REQUIRE( ncGetRemoteObjectCount(serverPeers[i]) == 1 );
+                auto view = ncGetRemoteObject(serverPeers[i], 0);
+                REQUIRE( ncGetObjectInt(view, cursorX) == frame * i );
+                ncSetObjectRef(players[i], playerCursor, view);
+            }
+            else REQUIRE( ncGetRemoteObjectCount(serverPeers[i]) == 0 );
+        }
+
+        // Once views of destroyed cursors are no longer needed to decode updates, references to them should be purged
+        if(frame == 29) for(auto player : players) REQUIRE( ncGetObjectRef(player, playerCursor) == nullptr );
+
+        // Send acknowledgements back to each client
+        ncPublishFrame(serverAuth);
+        ncProduceMessages(serverAuth, serverPeers.data(), serverPeers.size(), blobs.data());
+        for(size_t i=0; i<clientPeers.size(); ++i)
+        {
+            ncConsumeMessage(clientPeers[i], ncGetBlobData(blobs[i]), ncGetBlobSize(blobs[i]));
+            ncFreeBlob(blobs[i]);
+        }
+    }
+
+    for(auto peer : serverPeers) ncDestroyPeer(peer);
+    for(auto peer : clientPeers) ncDestroyPeer(peer);
+    for(auto auth : clientAuths) ncDestroyAuthority(auth);
+    ncDestroyAuthority(serverAuth);
+    ncDestroyProtocol(protocol);
+}
+
+TEST_CASE( "Peers which stop acknowledging frames do not cause the authority to retain history", "[protocol]" )
+{
+    Loopback loop;
+    auto stalledPeer = ncCreatePeer(loop.serverAuth);
+    loop.SpawnUnits(20);
+    for(auto unit : loop.units) ncSetVisibility(stalledPeer, unit, 1);
+
+    // Messages to the stalled peer are never delivered
+    for(int i=0; i<200; ++i)
+    {
+        loop.MoveUnits(i);
+        loop.Exchange(0.1);
+        ncFreeBlob(ncProduceMessage(stalledPeer));
+    }
+    REQUIRE( loop.serverAuth->frameState.size() <= 31 );
+    REQUIRE( loop.serverAuth->eventHistory.size() <= 31 );
+
+    // Once the stalled peer begins receiving messages again, it is sent a keyframe
+    auto clientAuth = ncCreateAuthority(loop.protocol);
+    auto clientPeer = ncCreatePeer(clientAuth);
+    for(int i=0; i<3; ++i)
+    {
+        ncPublishFrame(loop.serverAuth);
+        ncPublishFrame(clientAuth);
+        auto update = ncProduceMessage(stalledPeer);
+        ncConsumeMessage(clientPeer, ncGetBlobData(update), ncGetBlobSize(update));
+        ncFreeBlob(update);
+        auto response = ncProduceMessage(clientPeer);
+        ncConsumeMessage(stalledPeer, ncGetBlobData(response), ncGetBlobSize(response));
+        ncFreeBlob(response);
+    }
+    REQUIRE( ncGetRemoteObjectCount(clientPeer) == loop.units.size() );
+
+    ncDestroyPeer(clientPeer);
+    ncDestroyPeer(stalledPeer);
+    ncDestroyAuthority(clientAuth);
+}
+
+TEST_CASE( "Unique IDs are recycled under heavy churn, so the cost of creating objects does not grow over time", "[protocol]" )
+{
+    NCclass * cl;
+    NCint * tag;
+    Loopback loop([&](NCprotocol * protocol)
+    {
+        cl = ncCreateClass(protocol, 0);
+        tag = ncCreateInt(cl, NC_CONST_FIELD_FLAG);
+    });
+
+    // Keep fifty objects alive, replacing five of them on every frame
+    std::mt19937 engine(0);
+    std::vector<NCobject *> objects;
+    int nextTag = 0, earlyBytes = 0, lateBytes = 0, maxId = 0;
+    for(int i=0; i<1000; ++i)
+    {
+        for(int j=0; j<5 && !objects.empty(); ++j)
+        {
+            auto it = begin(objects) + engine() % objects.size();
+            ncDestroyObject(*it);
+            objects.erase(it);
+        }
+        while(objects.size() < 50)
+        {
+            objects.push_back(loop.Spawn(cl));
+            ncSetObjectInt(objects.back(), tag, nextTag++ % 256); // Tags are bounded so that only the cost of IDs could grow
+        }
+
+        int bytes = loop.Exchange(0.1);
+        if(i >= 100 && i < 200) earlyBytes += bytes;
+        if(i >= 900) lateBytes += bytes;
+        for(int j=0, n=ncGetRemoteObjectCount(loop.clientPeer); j<n; ++j) maxId = std::max(maxId, loop.clientPeer->remote.GetUniqueIdFromObject(ncGetRemoteObject(loop.clientPeer, j)));
+    }
+
+    // Views created for recycled IDs must not be confused with the views of the objects which previously held them
+    loop.Exchange(0);
+    REQUIRE( ncGetRemoteObjectCount(loop.clientPeer) == objects.size() );
+    for(size_t j=0; j<objects.size(); ++j) REQUIRE( ncGetObjectInt(ncGetRemoteObject(loop.clientPeer, j), tag) == ncGetObjectInt(objects[j], tag) );
+
+    // IDs are only reused once the client has discarded every frame in which they were live, which bounds them by the churn over the frame window
+    REQUIRE( maxId < 50 + 5 * 60 );
+    REQUIRE( lateBytes < earlyBytes * 1.05 );
+}
+
+TEST_CASE( "Deleted indices are decoded correctly, and mass despawns cost less than uniformly coded indices", "[protocol]" )
+{
+    // Generate a despawn-heavy trace, in which waves of contiguous objects are destroyed alongside scattered individual objects
+    std::mt19937 engine(0);
+    std::vector<std::pair<int, std::vector<int>>> frames;
+    for(int i=0; i<200; ++i)
+    {
+        const int numPrevObjects = 500;
+        std::set<int> deleted;
+        if(i % 10 == 0) for(int first = engine() % 400, j = 0, n = engine() % 80 + 20; j<n; ++j) deleted.insert(first + j);
+        for(int j=0, n = engine() % 4; j<n; ++j) deleted.insert(engine() % numPrevObjects);
+        frames.push_back({numPrevObjects, {begin(deleted), end(deleted)}});
+    }
+
+    std::vector<uint8_t> gapBuffer, uniformBuffer;
+    netcode::ArithmeticEncoder gapEncoder(gapBuffer), uniformEncoder(uniformBuffer);
+    netcode::Distribs encoderDistribs, uniformDistribs;
+    for(auto & frame : frames)
+    {
+        encoderDistribs.EncodeAndTallyDeletions(gapEncoder, frame.second);
+        uniformDistribs.delObjectCountDist.EncodeAndTally(uniformEncoder, frame.second.size());
+        for(auto index : frame.second) netcode::EncodeUniform(uniformEncoder, index, frame.first);
+    }
+    gapEncoder.Finish();
+    uniformEncoder.Finish();
+
+    netcode::ArithmeticDecoder decoder(gapBuffer);
+    netcode::Distribs decoderDistribs;
+    for(auto & frame : frames) REQUIRE( decoderDistribs.DecodeAndTallyDeletions(decoder, frame.first) == frame.second );
+    REQUIRE( (gapBuffer.size() * 2) < uniformBuffer.size() );
+}
+
+TEST_CASE( "Peers which join on the same frame share a single keyframe", "[protocol]" )
+{
+    Loopback loop;
+    loop.SpawnUnits(100);
+    for(int i=0; i<10; ++i)
+    {
+        loop.MoveUnits(i);
+        loop.Exchange(0);
+    }
+
+    // Several peers join at once and see every unit, so the server sends each of them the same keyframe, split into several parts
+    std::vector<NCauthority *> clientAuths;
+    std::vector<NCpeer *> serverPeers, clientPeers;
+    for(int i=0; i<8; ++i)
+    {
+        clientAuths.push_back(ncCreateAuthority(loop.protocol));
+        clientPeers.push_back(ncCreatePeer(clientAuths.back()));
+        serverPeers.push_back(ncCreatePeer(loop.serverAuth));
+        ncSetMaxMessageSize(serverPeers.back(), 200);
+        for(auto unit : loop.units) ncSetVisibility(serverPeers.back(), unit, 1);
+    }
+
+    std::vector<NCblob *> blobs(serverPeers.size());
+    for(int i=10; i<30; ++i)
+    {
+        loop.MoveUnits(i);
+        loop.Exchange(0);
+        if(i == 10)
+        {
+            // Messages are produced serially on this frame, as peers encoding at the same moment could each miss the cache
+            for(size_t j=0; j<serverPeers.size(); ++j) blobs[j] = ncProduceMessage(serverPeers[j]);
+            REQUIRE( loop.serverAuth->keyframes.size() == 1 );
+            REQUIRE( ncGetNextBlob(blobs[0]) != nullptr );
+            for(auto blob : blobs)
+            {
+                for(auto a = (const NCblob *)blob, b = (const NCblob *)blobs[0]; a || b; a = ncGetNextBlob(a), b = ncGetNextBlob(b))
+                {
+                    REQUIRE( a );
+                    REQUIRE( b );
+                    REQUIRE( ncGetBlobSize(a) == ncGetBlobSize(b) );
+                    REQUIRE( memcmp(ncGetBlobData(a), ncGetBlobData(b), ncGetBlobSize(a)) == 0 );
+                }
+            }
+        }
+        else ncProduceMessages(loop.serverAuth, serverPeers.data(), serverPeers.size(), blobs.data());
+
+        // Each peer must be able to continue from the shared keyframe as though it had been encoded specifically for that peer
+        for(size_t j=0; j<serverPeers.size(); ++j)
+        {
+            ncPublishFrame(clientAuths[j]);
+            for(auto part = (const NCblob *)blobs[j]; part; part = ncGetNextBlob(part)) ncConsumeMessage(clientPeers[j], ncGetBlobData(part), ncGetBlobSize(part));
+            ncFreeBlob(blobs[j]);
+            auto response = ncProduceMessage(clientPeers[j]);
+            ncConsumeMessage(serverPeers[j], ncGetBlobData(response), ncGetBlobSize(response));
+            ncFreeBlob(response);
+        }
+    }
+
+    for(auto peer : clientPeers)
+    {
+        REQUIRE( ncGetRemoteObjectCount(peer) == loop.units.size() );
+        for(int i=0, n=ncGetRemoteObjectCount(peer); i<n; ++i)
+        {
+            auto view = ncGetRemoteObject(peer, i);
+            auto unit = loop.units[ncGetObjectInt(view, loop.unitTag)];
+            REQUIRE( ncGetObjectInt(view, loop.unitX) == ncGetObjectInt(unit, loop.unitX) );
+            REQUIRE( ncGetObjectInt(view, loop.unitY) == ncGetObjectInt(unit, loop.unitY) );
+        }
+    }
+
+    for(auto peer : serverPeers) ncDestroyPeer(peer);
+    for(auto peer : clientPeers) ncDestroyPeer(peer);
+    for(auto auth : clientAuths) ncDestroyAuthority(auth);
+}
+
+TEST_CASE( "Acknowledgements survive heavy loss when reported over a wide ack window", "[protocol]" )
+{
+    Loopback loop;
+    ncSetAckWindow(loop.protocol, 30);
+    loop.SpawnUnits(50);
+    for(int i=0; i<200; ++i)
+    {
+        loop.MoveUnits(i);
+        loop.Exchange(0.5);
+    }
+    for(int i=0; i<3; ++i) loop.Exchange(0);
+    loop.RequireSynchronized();
+
+    // Every frame received by the client remains acknowledged, even though most of its responses were lost
+    REQUIRE( loop.serverPeer->local.GetOldestAckFrame() <= loop.serverAuth->frame - 3 );
+}
+
+TEST_CASE( "Acknowledgements are coded compactly when most frames in the ack window arrived, or most were lost", "[protocol]" )
+{
+    auto encode = [](const std::vector<int> & frames)
+    {
+        std::vector<uint8_t> buffer;
+        netcode::ArithmeticEncoder encoder(buffer);
+        netcode::EncodeAcks(encoder, frames, 30);
+        encoder.Finish();
+
+        netcode::ArithmeticDecoder decoder(buffer);
+        REQUIRE( netcode::DecodeAcks(decoder, 30, 1000) == frames );
+        return buffer.size();
+    };
+
+    // Sending every bit of the bitfield uniformly would take one bit for the flag, frameBits for the newest frame, and one bit for each frame in the window
+    const size_t uniformSize = (1 + netcode::frameBits + 30 + 7) / 8;
+    std::vector<int> all, none = {1000}, bursts;
+    for(int i=0; i<=30; ++i) all.push_back(1000 - i);
+    for(int i=0; i<=30; ++i) if(i % 10 < 6) bursts.push_back(1000 - i);
+    REQUIRE( encode({}) <= 1 );
+    REQUIRE( encode(all) <= uniformSize / 2 );
+    REQUIRE( encode(none) <= uniformSize / 2 );
+    REQUIRE( encode(bursts) < uniformSize );
+}
+
+TEST_CASE( "Samples for curve predictors are chosen among acknowledged frames to reduce the size of updates under heavy loss", "[protocol]" )
+{
+    // Units follow smooth curves over a connection which loses nearly a third of all messages
+    auto replicate = [](int sampleCandidates)
+    {
+        Loopback loop;
+        ncSetAckWindow(loop.protocol, 30);
+        ncSetSampleCandidates(loop.protocol, sampleCandidates);
+        loop.SpawnUnits(50);
+        int bytes = 0;
+        for(int i=0; i<300; ++i)
+        {
+            for(size_t j=0; j<loop.units.size(); ++j)
+            {
+                ncSetObjectInt(loop.units[j], loop.unitX, static_cast<int>(2000 * std::sin((i * 0.05 + j) * 0.7)));
+                ncSetObjectInt(loop.units[j], loop.unitY, static_cast<int>(2000 * std::cos((i * 0.05 + j) * 0.4)));
+            }
+            bytes += loop.Exchange(0.3);
+        }
+        for(int i=0; i<3; ++i) loop.Exchange(0);
+        loop.RequireSynchronized();
+        return bytes;
+    };
+
+    // With only three candidates, the newest four acknowledged frames are always used
+    REQUIRE( replicate(6) < replicate(3) * 9 / 10 );
+}
+
+TEST_CASE( "Frame numbers sent as low bits are resolved correctly when those bits wrap around", "[protocol]" )
+{
+    // Start just short of a multiple of 2^frameBits, so that frames are numbered on both sides of the boundary
+    Loopback loop;
+    loop.serverAuth->frame = (1 << netcode::frameBits) * 3 - 40;
+    loop.SpawnUnits(20);
+    for(int i=0; i<100; ++i)
+    {
+        loop.MoveUnits(i);
+        loop.Exchange(0.2);
+    }
+    for(int i=0; i<3; ++i) loop.Exchange(0);
+    loop.RequireSynchronized();
+    REQUIRE( loop.serverPeer->local.GetOldestAckFrame() > (1 << netcode::frameBits) * 3 );
+
+    // Frames are resolved to the nearest frame with the same low bits which is not after the newest frame
+    REQUIRE( netcode::ResolveFrame(5, (1 << netcode::frameBits) + 10) == (1 << netcode::frameBits) + 5 );
+    REQUIRE( netcode::ResolveFrame((1 << netcode::frameBits) - 3, (1 << netcode::frameBits) + 10) == (1 << netcode::frameBits) - 3 );
+    REQUIRE( netcode::ResolveFrame(10, 10) == 10 );
+}
+
+// Predicts a position by advancing its previous value by the velocity on the current frame, which precedes it in the class
+static int PredictFromVelocity(const NCsamples * samples, void * userdata)
+{
+    auto fields = reinterpret_cast<NCint * const *>(userdata);
+    if(ncGetSampleCount(samples) == 0) return 0;
+    return ncGetSampleInt(samples, 1, fields[1]) + ncGetSampleInt(samples, 0, fields[0]) * ncGetSampleFrameDelta(samples, 1);
+}
+
+TEST_CASE( "Custom field predictors are used by both peers when they predict better than curves", "[protocol]" )
+{
+    auto replicate = [](bool usePredictor)
+    {
+        NCclass * cl;
+        NCint * fields[2]; // Velocity, then position
+        Loopback loop([&](NCprotocol * protocol)
+        {
+            cl = ncCreateClass(protocol, 0);
+            for(auto & field : fields) field = ncCreateInt(cl, 0);
+            if(usePredictor) ncAddFieldPredictor(fields[1], PredictFromVelocity, fields);
+        });
+
+        // Objects change velocity at random on every frame
+        std::mt19937 engine(0);
+        std::uniform_int_distribution<int> acceleration(-50, 50);
+        std::vector<NCobject *> objects;
+        for(int i=0; i<20; ++i) objects.push_back(loop.Spawn(cl));
+
+        int bytes = 0;
+        for(int i=0; i<100; ++i)
+        {
+            for(auto obj : objects)
+            {
+                ncSetObjectInt(obj, fields[0], ncGetObjectInt(obj, fields[0]) + acceleration(engine));
+                ncSetObjectInt(obj, fields[1], ncGetObjectInt(obj, fields[1]) + ncGetObjectInt(obj, fields[0]));
+            }
+            bytes += loop.Exchange(0);
+        }
+
+        REQUIRE( ncGetRemoteObjectCount(loop.clientPeer) == objects.size() );
+        for(size_t i=0; i<objects.size(); ++i)
+        {
+            for(auto field : fields) REQUIRE( ncGetObjectInt(ncGetRemoteObject(loop.clientPeer, i), field) == ncGetObjectInt(objects[i], field) );
+        }
+        return bytes;
+    };
+
+    REQUIRE( replicate(true) < replicate(false) * 3 / 4 );
+}
+
+TEST_CASE( "Locking in predictors after warmup does not desynchronize the remote peer", "[protocol]" )
+{
+    Loopback loop;
+    ncSetPredictorWarmup(loop.protocol, 30);
+    loop.SpawnUnits(100);
+    ncSetMaxMessageSize(loop.serverPeer, 200);
+    for(int i=0; i<200; ++i)
+    {
+        loop.MoveUnits(i);
+        loop.Exchange(0.2);
+    }
+    for(int i=0; i<3; ++i) loop.Exchange(0);
+    loop.RequireSynchronized();
+}
+
+
+TEST_CASE( "Context modeling by motion reduces the size of updates to units which start and stop", "[protocol]" )
+{
+    auto replicate = [](bool useContext)
+    {
+        NCclass * cl;
+        NCint * x, * y;
+        Loopback loop([&](NCprotocol * protocol)
+        {
+            cl = ncCreateClass(protocol, 0);
+            x = ncCreateInt(cl, 0);
+            y = ncCreateInt(cl, 0);
+            if(useContext)
+            {
+                ncSetFieldContext(x, x);
+                ncSetFieldContext(y, x); // Units which moved horizontally on this frame are likely to have moved vertically
+            }
+        });
+
+        // Units alternate between standing still and walking in a random direction
+        std::mt19937 engine(0);
+        std::uniform_int_distribution<int> direction(-8, 8), duration(5, 30);
+        struct Unit { NCobject * object; int dx, dy, framesLeft; };
+        std::vector<Unit> units;
+        for(int i=0; i<50; ++i) units.push_back({loop.Spawn(cl), 0, 0, duration(engine)});
+
+        int bytes = 0;
+        for(int i=0; i<300; ++i)
+        {
+            for(auto & unit : units)
+            {
+                if(--unit.framesLeft == 0)
+                {
+                    bool isWalking = unit.dx == 0 && unit.dy == 0;
+                    unit.dx = isWalking ? direction(engine) | 1 : 0;
+                    unit.dy = isWalking ? direction(engine) : 0;
+                    unit.framesLeft = duration(engine);
+                }
+                ncSetObjectInt(unit.object, x, ncGetObjectInt(unit.object, x) + unit.dx + (unit.dx ? direction(engine)/4 : 0));
+                ncSetObjectInt(unit.object, y, ncGetObjectInt(unit.object, y) + unit.dy + (unit.dx ? direction(engine)/4 : 0));
+            }
+            bytes += loop.Exchange(0);
+        }
+
+        REQUIRE( ncGetRemoteObjectCount(loop.clientPeer) == units.size() );
+        for(size_t i=0; i<units.size(); ++i)
+        {
+            REQUIRE( ncGetObjectInt(ncGetRemoteObject(loop.clientPeer, i), x) == ncGetObjectInt(units[i].object, x) );
+            REQUIRE( ncGetObjectInt(ncGetRemoteObject(loop.clientPeer, i), y) == ncGetObjectInt(units[i].object, y) );
+        }
+        return bytes;
+    };
+
+    REQUIRE( replicate(true) < replicate(false) * 9 / 10 );
+}
+
+TEST_CASE( "Enum and bool fields are replicated correctly alongside integer fields", "[protocol]" )
+{
+    NCclass * cl, * ev;
+    NCint * kind, * x, * state, * alive, * y, * critical;
+    Loopback loop([&](NCprotocol * protocol)
+    {
+        cl = ncCreateClass(protocol, 0);
+        ev = ncCreateClass(protocol, NC_EVENT_CLASS_FLAG);
+        kind = ncCreateEnum(cl, 5, NC_CONST_FIELD_FLAG);
+        x = ncCreateInt(cl, 0);
+        state = ncCreateEnum(cl, 3, 0);
+        alive = ncCreateBool(cl, 0);
+        y = ncCreateInt(cl, 0);
+        critical = ncCreateBool(ev, NC_CONST_FIELD_FLAG);
+        REQUIRE( ncCreateEnum(cl, 0, 0) == nullptr );
+        REQUIRE( ncCreateEnum(cl, 257, 0) == nullptr );
+        REQUIRE( ncCreateBool(ev, 0) == nullptr );
+    });
+
+    std::mt19937 engine(0);
+    std::uniform_int_distribution<int> roll(0, 99);
+    std::vector<NCobject *> units;
+    for(int i=0; i<20; ++i)
+    {
+        units.push_back(loop.Spawn(cl));
+        ncSetObjectInt(units.back(), kind, i % 5);
+        ncSetObjectInt(units.back(), alive, 1);
+    }
+    ncSetObjectInt(units[0], state, 3); // Out of range values are ignored
+    REQUIRE( ncGetObjectInt(units[0], state) == 0 );
+
+    int events = 0;
+    for(int i=0; i<100; ++i)
+    {
+        for(auto unit : units)
+        {
+            ncSetObjectInt(unit, x, i * 3);
+            ncSetObjectInt(unit, y, -i);
+            if(roll(engine) < 10) ncSetObjectInt(unit, state, roll(engine) % 3);
+            if(roll(engine) < 5) ncSetObjectInt(unit, alive, !ncGetObjectInt(unit, alive));
+        }
+        ncSetObjectInt(loop.Spawn(ev), critical, i % 3 == 0);
+        loop.Exchange(0);
+
+        size_t count = 0;
+        for(int j=0, n=ncGetRemoteObjectCount(loop.clientPeer); j<n; ++j)
+        {
+            auto view = ncGetRemoteObject(loop.clientPeer, j);
+            if(ncGetObjectClass(view) == ev)
+            {
+                REQUIRE( ncGetObjectInt(view, critical) == (i % 3 == 0) );
+                ++events;
+                continue;
+            }
+            auto & unit = units[count++];
+            REQUIRE( ncGetObjectInt(view, kind) == ncGetObjectInt(unit, kind) );
+            REQUIRE( ncGetObjectInt(view, x) == ncGetObjectInt(unit, x) );
+            REQUIRE( ncGetObjectInt(view, state) == ncGetObjectInt(unit, state) );
+            REQUIRE( ncGetObjectInt(view, alive) == ncGetObjectInt(unit, alive) );
+            REQUIRE( ncGetObjectInt(view, y) == ncGetObjectInt(unit, y) );
+        }
+        REQUIRE( count == units.size() );
+    }
+    REQUIRE( events == 100 );
+}
+
+TEST_CASE( "Float fields are quantized to their declared range and precision", "[protocol]" )
+{
+    NCclass * cl;
+    NCfloat * x, * y, * z;
+    Loopback loop([&](NCprotocol * protocol)
+    {
+        cl = ncCreateClass(protocol, 0);
+        x = ncCreateFloat(cl, -100, 100, 0.5f, 0);
+        y = ncCreateFloat(cl, 0, 50, 0.125f, 0);
+        z = ncCreateFloat(cl, 0, 1, 0.3f, 0);
+        REQUIRE( ncCreateFloat(cl, 0, 1, 0, 0) == nullptr );
+        REQUIRE( ncCreateFloat(cl, 1, 0, 0.5f, 0) == nullptr );
+    });
+
+    auto unit = loop.Spawn(cl);
+    ncSetObjectFloat(unit, x, 12.3f);
+    REQUIRE( ncGetObjectFloat(unit, x) == 12.5f );
+    ncSetObjectFloat(unit, x, -250);
+    REQUIRE( ncGetObjectFloat(unit, x) == -100 );
+    ncSetObjectFloat(unit, y, 1000);
+    REQUIRE( ncGetObjectFloat(unit, y) == 50 );
+    ncSetObjectFloat(unit, z, 1);
+    REQUIRE( ncGetObjectFloat(unit, z) == 1 ); // The range is not a multiple of the precision, so the last step is shorter
+
+    for(int i=0; i<100; ++i)
+    {
+        ncSetObjectFloat(unit, x, std::sin(i * 0.1f) * 90);
+        ncSetObjectFloat(unit, y, i * 0.37f);
+        loop.Exchange(0);
+
+        REQUIRE( ncGetRemoteObjectCount(loop.clientPeer) == 1 );
+        auto view = ncGetRemoteObject(loop.clientPeer, 0);
+        REQUIRE( ncGetObjectFloat(view, x) == ncGetObjectFloat(unit, x) );
+        REQUIRE( ncGetObjectFloat(view, y) == ncGetObjectFloat(unit, y) );
+        REQUIRE( std::abs(ncGetObjectFloat(view, x) - std::sin(i * 0.1f) * 90) <= 0.25f );
+        REQUIRE( std::abs(ncGetObjectFloat(view, y) - i * 0.37f) <= 0.0625f );
+    }
+}
+
+TEST_CASE( "Float fields cost no more than integer fields holding values truncated by hand", "[protocol]" )
+{
+    // Units move at a few pixels per frame, bouncing off the walls of the arena, with positions sent to whole pixels
+    auto replicate = [](bool useFloat)
+    {
+        NCclass * cl;
+        NCfloat * fx, * fy;
+        NCint * ix, * iy;
+        Loopback loop([&](NCprotocol * protocol)
+        {
+            cl = ncCreateClass(protocol, 0);
+            if(useFloat)
+            {
+                fx = ncCreateFloat(cl, 0, 640, 1, 0);
+                fy = ncCreateFloat(cl, 0, 480, 1, 0);
+            }
+            else
+            {
+                ix = ncCreateInt(cl, 0);
+                iy = ncCreateInt(cl, 0);
+            }
+        });
+
+        std::mt19937 engine(0);
+        std::uniform_real_distribution<float> position(0, 480), velocity(-4, 4);
+        std::vector<std::pair<NCobject *, std::array<float,4>>> units;
+        for(int i=0; i<50; ++i) units.push_back({loop.Spawn(cl), {{position(engine), position(engine), velocity(engine), velocity(engine)}}});
+
+        int bytes = 0;
+        for(int i=0; i<300; ++i)
+        {
+            for(auto & unit : units)
+            {
+                auto & u = unit.second;
+                u[0] += u[2];
+                u[1] += u[3];
+                if(u[0] < 0 || u[0] > 640) { u[2] = -u[2]; u[0] = std::min(std::max(u[0], 0.0f), 640.0f); }
+                if(u[1] < 0 || u[1] > 480) { u[3] = -u[3]; u[1] = std::min(std::max(u[1], 0.0f), 480.0f); }
+                if(useFloat)
+                {
+                    ncSetObjectFloat(unit.first, fx, u[0]);
+                    ncSetObjectFloat(unit.first, fy, u[1]);
+                }
+                else
+                {
+                    ncSetObjectInt(unit.first, ix, static_cast<int>(u[0]));
+                    ncSetObjectInt(unit.first, iy, static_cast<int>(u[1]));
+                }
+            }
+            bytes += loop.Exchange(0.1);
+        }
+        return bytes;
+    };
+
+    // Curve predictions which overshoot the walls are clamped to the declared range, which the integer fields cannot do
+    REQUIRE( replicate(true) <= replicate(false) );
+}
+
+TEST_CASE( "64-bit fields are replicated correctly and cost less than splitting values across two fields", "[protocol]" )
+{
+    auto replicate = [](bool useInt64)
+    {
+        NCclass * cl;
+        NCint64 * guid, * time, * balance;
+        NCint * timeLo, * timeHi;
+        Loopback loop([&](NCprotocol * protocol)
+        {
+            cl = ncCreateClass(protocol, 0);
+            guid = ncCreateInt64(cl, NC_CONST_FIELD_FLAG);
+            time = ncCreateInt64(cl, 0);
+            balance = ncCreateInt64(cl, 0);
+            timeLo = ncCreateInt(cl, 0);
+            timeHi = ncCreateInt(cl, 0);
+        });
+
+        std::mt19937 engine(0);
+        std::uniform_int_distribution<int64_t> anyValue(INT64_MIN, INT64_MAX);
+        std::vector<NCobject *> units;
+        for(int i=0; i<10; ++i)
+        {
+            units.push_back(loop.Spawn(cl));
+            ncSetObjectInt64(units.back(), guid, anyValue(engine));
+        }
+
+        // Times count microseconds of simulated time at a high rate, carrying into the upper 32 bits every few frames, while balances wrap around the end of the range
+        int64_t timestamp = 1450000000000000;
+        int bytes = 0;
+        for(int i=0; i<200; ++i)
+        {
+            timestamp += 300000000 + engine() % 1000;
+            for(size_t j=0; j<units.size(); ++j)
+            {
+                const int64_t t = timestamp + j * 400000000;
+                if(useInt64) ncSetObjectInt64(units[j], time, t);
+                else
+                {
+                    ncSetObjectInt(units[j], timeLo, static_cast<int>(t & 0xFFFFFFFF));
+                    ncSetObjectInt(units[j], timeHi, static_cast<int>(t >> 32));
+                }
+                ncSetObjectInt64(units[j], balance, static_cast<int64_t>(uint64_t(INT64_MAX) - 1000 + uint64_t(i) * 10 * (j+1)));
+            }
+            bytes += loop.Exchange(0.1);
+        }
+
+        loop.Exchange(0);
+        REQUIRE( ncGetRemoteObjectCount(loop.clientPeer) == units.size() );
+        for(size_t j=0; j<units.size(); ++j)
+        {
+            auto view = ncGetRemoteObject(loop.clientPeer, j);
+            REQUIRE( ncGetObjectInt64(view, guid) == ncGetObjectInt64(units[j], guid) );
+            REQUIRE( ncGetObjectInt64(view, time) == ncGetObjectInt64(units[j], time) );
+            REQUIRE( ncGetObjectInt64(view, balance) == ncGetObjectInt64(units[j], balance) );
+            REQUIRE( ncGetObjectInt(view, timeLo) == ncGetObjectInt(units[j], timeLo) );
+            REQUIRE( ncGetObjectInt(view, timeHi) == ncGetObjectInt(units[j], timeHi) );
+        }
+        return bytes;
+    };
+
+    REQUIRE( replicate(true) < replicate(false) );
+}
+
+TEST_CASE( "Vector fields are replicated correctly and cost less than independent components", "[protocol]" )
+{
+    auto replicate = [](bool useVec)
+    {
+        NCclass * cl;
+        NCint * hp, * coords[3] = {};
+        NCvec * tag, * pos = nullptr;
+        Loopback loop([&](NCprotocol * protocol)
+        {
+            cl = ncCreateClass(protocol, 0);
+            hp = ncCreateInt(cl, 0);
+            tag = ncCreateVec(cl, 2, NC_CONST_FIELD_FLAG);
+            if(useVec) pos = ncCreateVec(cl, 3, 0);
+            else for(auto & coord : coords) coord = ncCreateInt(cl, 0);
+            REQUIRE( ncCreateVec(cl, 0, 0) == nullptr );
+        });
+
+        // Units walk in a random direction, and occasionally stop or turn
+        std::mt19937 engine(0);
+        std::uniform_int_distribution<int> velocity(-12, 12), roll(0, 19);
+        struct Unit { NCobject * object; int position[3], velocity[3]; };
+        std::vector<Unit> units;
+        for(int i=0; i<50; ++i)
+        {
+            units.push_back({loop.Spawn(cl), {i*100, i*50, 0}, {velocity(engine), velocity(engine), 0}});
+            int tags[2] = {i, -i};
+            ncSetObjectVec(units.back().object, tag, tags);
+        }
+
+        int bytes = 0;
+        for(int i=0; i<200; ++i)
+        {
+            for(auto & unit : units)
+            {
+                if(roll(engine) == 0) for(auto & v : unit.velocity) v = roll(engine) < 10 ? 0 : velocity(engine);
+                for(int k=0; k<3; ++k) unit.position[k] += unit.velocity[k];
+                if(useVec) ncSetObjectVec(unit.object, pos, unit.position);
+                else for(int k=0; k<3; ++k) ncSetObjectInt(unit.object, coords[k], unit.position[k]);
+                ncSetObjectInt(unit.object, hp, 100 - i/4);
+            }
+            bytes += loop.Exchange(0.1);
+        }
+
+        loop.Exchange(0);
+        REQUIRE( ncGetRemoteObjectCount(loop.clientPeer) == units.size() );
+        for(size_t i=0; i<units.size(); ++i)
+        {
+            auto view = ncGetRemoteObject(loop.clientPeer, i);
+            int position[3], tags[2];
+            if(useVec) ncGetObjectVec(view, pos, position);
+            else for(int k=0; k<3; ++k) position[k] = ncGetObjectInt(view, coords[k]);
+            ncGetObjectVec(view, tag, tags);
+            REQUIRE( ncGetObjectInt(view, hp) == ncGetObjectInt(units[i].object, hp) );
+            REQUIRE( tags[0] == i );
+            REQUIRE( tags[1] == -int(i) );
+            for(int k=0; k<3; ++k) REQUIRE( position[k] == units[i].position[k] );
+        }
+        return bytes;
+    };
+
+    int vecBytes = replicate(true), intBytes = replicate(false);
+    REQUIRE( vecBytes < intBytes );
+}
+
+TEST_CASE( "Blob fields are replicated correctly, and repeated values are sent by reference", "[protocol]" )
+{
+    NCclass * cl, * ev;
+    NCbytes * name, * loadout, * chat;
+    Loopback loop([&](NCprotocol * protocol)
+    {
+        cl = ncCreateClass(protocol, 0);
+        ev = ncCreateClass(protocol, NC_EVENT_CLASS_FLAG);
+        name = ncCreateBytes(cl, 32, NC_CONST_FIELD_FLAG);
+        loadout = ncCreateBytes(cl, 256, 0);
+        chat = ncCreateBytes(ev, 256, NC_CONST_FIELD_FLAG);
+        REQUIRE( ncCreateBytes(ev, 16, 0) == nullptr );
+    });
+    auto getString = [](const NCobject * object, const NCbytes * field) { int size; auto data = ncGetObjectBytes(object, field, &size); return std::string(reinterpret_cast<const char *>(data), size); };
+    auto setString = [](NCobject * object, const NCbytes * field, const std::string & value) { ncSetObjectBytes(object, field, value.data(), value.size()); };
+
+    const std::string loadouts[] = {"", "sword, shield, potion of healing", "bow, quiver of arrows, leather armor", "staff, robe, spellbook of fire"};
+    std::vector<NCobject *> units;
+    for(int i=0; i<10; ++i)
+    {
+        units.push_back(loop.Spawn(cl));
+        setString(units.back(), name, "Unit " + std::to_string(i));
+    }
+    setString(units[0], name, std::string(33, 'x')); // Values which exceed the maximum size are ignored
+    REQUIRE( getString(units[0], name) == "Unit 0" );
+
+    std::mt19937 engine(0);
+    std::uniform_int_distribution<int> roll(0, 99);
+    std::set<std::string> messages;
+    for(int i=0; i<200; ++i)
+    {
+        // Units change loadouts occasionally, always choosing from the same few values
+        for(auto unit : units) if(roll(engine) < 5) setString(unit, loadout, loadouts[roll(engine) % 4]);
+        if(i % 10 == 0) setString(loop.Spawn(ev), chat, "Message " + std::to_string(i));
+        loop.Exchange(0.1);
+        for(int j=0, n=ncGetRemoteObjectCount(loop.clientPeer); j<n; ++j)
+        {
+            auto view = ncGetRemoteObject(loop.clientPeer, j);
+            if(ncGetObjectClass(view) == ev) messages.insert(getString(view, chat));
+        }
+    }
+    REQUIRE( messages.size() == 20 );
+    REQUIRE( messages.count("Message 190") == 1 );
+    for(int i=0; i<3; ++i) loop.Exchange(0);
+
+    REQUIRE( ncGetRemoteObjectCount(loop.clientPeer) == units.size() );
+    for(size_t i=0; i<units.size(); ++i)
+    {
+        auto view = ncGetRemoteObject(loop.clientPeer, i);
+        REQUIRE( getString(view, name) == getString(units[i], name) );
+        REQUIRE( getString(view, loadout) == getString(units[i], loadout) );
+    }
+
+    // Sending a loadout which the client has already seen costs far less than sending a new one
+    auto measure = [&](const std::string & value)
+    {
+        setString(units[3], loadout, value);
+        int size = loop.Exchange(0);
+        REQUIRE( getString(ncGetRemoteObject(loop.clientPeer, 3), loadout) == value );
+        return size;
+    };
+    measure(loadouts[1]);
+    int unchanged = measure(loadouts[1]), repeated = measure(loadouts[2]), literal = measure("dagger, cloak, lockpicks, rope, lantern");
+    REQUIRE( unchanged <= repeated );
+    REQUIRE( (repeated + 16) < literal );
+}
+
+TEST_CASE( "Blobs which are no longer referred to are evicted, so that distinct values do not accumulate", "[protocol]" )
+{
+    NCclass * cl, * ev;
+    NCbytes * status, * chat;
+    Loopback loop([&](NCprotocol * protocol)
+    {
+        cl = ncCreateClass(protocol, 0);
+        ev = ncCreateClass(protocol, NC_EVENT_CLASS_FLAG);
+        status = ncCreateBytes(cl, 64, 0);
+        chat = ncCreateBytes(ev, 64, NC_CONST_FIELD_FLAG);
+    });
+    auto getString = [](const NCobject * object, const NCbytes * field) { int size; auto data = ncGetObjectBytes(object, field, &size); return std::string(reinterpret_cast<const char *>(data), size); };
+    auto setString = [](NCobject * object, const NCbytes * field, const std::string & value) { ncSetObjectBytes(object, field, value.data(), value.size()); };
+
+    // Every frame carries several chat messages which are never repeated, and the unit's status changes to a value it has never held before
+    auto unit = loop.Spawn(cl);
+    std::set<std::string> messages;
+    size_t serverBlobs = 0, clientBlobs = 0;
+    for(int i=0; i<1000; ++i)
+    {
+        for(int j=0; j<5; ++j) setString(loop.Spawn(ev), chat, "Message " + std::to_string(i*5 + j));
+        setString(unit, status, "Status " + std::to_string(i));
+        loop.Exchange(0.1);
+        for(int j=0, n=ncGetRemoteObjectCount(loop.clientPeer); j<n; ++j)
+        {
+            auto view = ncGetRemoteObject(loop.clientPeer, j);
+            if(ncGetObjectClass(view) == ev) messages.insert(getString(view, chat));
+        }
+        serverBlobs = std::max(serverBlobs, loop.serverAuth->blobs.GetBlobCount());
+        clientBlobs = std::max(clientBlobs, loop.clientPeer->remote.GetBlobCount());
+    }
+    for(int i=0; i<3; ++i) loop.Exchange(0);
+    REQUIRE( messages.size() == 5000 );
+    REQUIRE( getString(ncGetRemoteObject(loop.clientPeer, 0), status) == "Status 999" );
+
+    // Only blobs in retained frames or in the dictionary of recently sent blobs are kept, rather than all six thousand values
+    REQUIRE( serverBlobs < netcode::maxBlobDictionary + 30 * 6 * 2 );
+    REQUIRE( clientBlobs < netcode::maxBlobDictionary + 30 * 6 * 2 );
+}
+
+TEST_CASE( "Array fields are replicated correctly, and cost less than modeling elements as child objects", "[protocol]" )
+{
+    // Each unit carries an inventory of item counts, which either lives in an array field or in a child object per item
+    auto replicate = [](bool useArray)
+    {
+        NCclass * unitClass, * itemClass;
+        NCarray * inventory = nullptr, * kinds;
+        NCref * itemOwner;
+        NCint * itemCount;
+        Loopback loop([&](NCprotocol * protocol)
+        {
+            unitClass = ncCreateClass(protocol, 0);
+            itemClass = ncCreateClass(protocol, 0);
+            if(useArray) inventory = ncCreateArray(unitClass, 8, 0);
+            kinds = ncCreateArray(unitClass, 4, NC_CONST_FIELD_FLAG);
+            itemOwner = ncCreateRef(itemClass);
+            itemCount = ncCreateInt(itemClass, 0);
+            REQUIRE( ncCreateArray(unitClass, -1, 0) == nullptr );
+        });
+
+        std::mt19937 engine(0);
+        std::uniform_int_distribution<int> roll(0, 99);
+        struct Unit { NCobject * object; std::vector<int> items; std::vector<NCobject *> children; };
+        std::vector<Unit> units;
+        for(int i=0; i<20; ++i)
+        {
+            units.push_back({loop.Spawn(unitClass), {10, 3}});
+            int unitKinds[3] = {i, i*2, i*3};
+            ncSetObjectArray(units.back().object, kinds, unitKinds, 3);
+        }
+
+        int bytes = 0;
+        for(int i=0; i<200; ++i)
+        {
+            for(auto & unit : units)
+            {
+                // Items are used up, picked up and occasionally dropped entirely
+                if(roll(engine) < 10 && !unit.items.empty()) --unit.items[roll(engine) % unit.items.size()];
+                if(roll(engine) < 3 && unit.items.size() < 8) unit.items.push_back(roll(engine) % 5 + 1);
+                unit.items.erase(std::remove(begin(unit.items), end(unit.items), 0), end(unit.items));
+                if(useArray) ncSetObjectArray(unit.object, inventory, unit.items.data(), unit.items.size());
+                else
+                {
+                    while(unit.children.size() > unit.items.size())
+                    {
+                        ncDestroyObject(unit.children.back());
+                        unit.children.pop_back();
+                    }
+                    while(unit.children.size() < unit.items.size())
+                    {
+                        unit.children.push_back(loop.Spawn(itemClass));
+                        ncSetObjectRef(unit.children.back(), itemOwner, unit.object);
+                    }
+                    for(size_t j=0; j<unit.items.size(); ++j) ncSetObjectInt(unit.children[j], itemCount, unit.items[j]);
+                }
+            }
+            bytes += loop.Exchange(0.1);
+
+            if(!useArray) continue;
+            for(int j=0, n=ncGetRemoteObjectCount(loop.clientPeer); j<n; ++j)
+            {
+                int values[8], unitKinds[4], length = ncGetObjectArray(ncGetRemoteObject(loop.clientPeer, j), inventory, values);
+                REQUIRE( length <= 8 );
+                REQUIRE( ncGetObjectArray(ncGetRemoteObject(loop.clientPeer, j), kinds, unitKinds) == 3 );
+                REQUIRE( unitKinds[2] == unitKinds[0] * 3 );
+                for(int k=0; k<length; ++k) REQUIRE( values[k] > 0 );
+            }
+        }
+
+        if(useArray)
+        {
+            loop.Exchange(0);
+            REQUIRE( ncGetRemoteObjectCount(loop.clientPeer) == units.size() );
+            for(size_t j=0; j<units.size(); ++j)
+            {
+                int values[8];
+                REQUIRE( ncGetObjectArray(ncGetRemoteObject(loop.clientPeer, j), inventory, values) == units[j].items.size() );
+                REQUIRE( std::equal(begin(units[j].items), end(units[j].items), values) );
+            }
+        }
+        return bytes;
+    };
+
+    REQUIRE( replicate(true) < replicate(false) );
+}